@@ -3,101 +3,96 @@
 
 #include "Tanks/Public/Animation/TankAnimInstance.h"
 
+#include "ChaosWheeledVehicleMovementComponent.h"
 #include "Kismet/KismetMathLibrary.h"
-#include "Net/UnrealNetwork.h"
 
-void UTankAnimInstance::NativeUpdateAnimation(float DeltaSeconds)
+void FTankAnimInstanceProxy::PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds)
 {
-	Super::NativeUpdateAnimation(DeltaSeconds);
+	Super::PreUpdate(InAnimInstance, DeltaSeconds);
 
-	UpdateSpeedOffset(DeltaSeconds);
-	SR_UpdateWheels();
-	SR_UpdateHatches();
-	SR_UpdateTurret();
-	SR_UpdateTracksMaterial();
+	const UTankAnimInstance* TankAnimInstance = CastChecked<UTankAnimInstance>(InAnimInstance);
+	bUpdateWheelsAndTracks = TankAnimInstance->bUpdateWheelsAndTracks;
+	bUpdateHatches = TankAnimInstance->bUpdateHatches;
+	WheelSpeed = TankAnimInstance->WheelSpeed;
+	TurretAngle = TankAnimInstance->TurretAngle;
+	GunElevation = TankAnimInstance->GunElevation;
+	HatchAngle = TankAnimInstance->HatchAngle;
 }
 
-void UTankAnimInstance::GetLifetimeReplicatedProps(TArray<class FLifetimeProperty>& OutLifetimeProps) const
+void FTankAnimInstanceProxy::Update(float DeltaSeconds)
 {
-	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
-
-	DOREPLIFETIME(UTankAnimInstance, WheelSpeed);
-	DOREPLIFETIME(UTankAnimInstance, TurretAngle);
-	DOREPLIFETIME(UTankAnimInstance, GunElevation);
-	DOREPLIFETIME(UTankAnimInstance, HatchAngle);
-	DOREPLIFETIME(UTankAnimInstance, WheelRotation);
-	DOREPLIFETIME(UTankAnimInstance, HatchRotation);
-	DOREPLIFETIME(UTankAnimInstance, TurretRotation);
-	DOREPLIFETIME(UTankAnimInstance, GunRotation);
-}
+	Super::Update(DeltaSeconds);
 
-void UTankAnimInstance::UpdateSpeedOffset(const double Increment)
-{
-	WheelSpeedOffset = UKismetMathLibrary::GenericPercent_FloatFloat(Increment + WheelSpeedOffset, 360.0);
-}
+	if (bUpdateWheelsAndTracks)
+	{
+		WheelSpeedOffset = UKismetMathLibrary::GenericPercent_FloatFloat(DeltaSeconds + WheelSpeedOffset, 360.0);
+		WheelRotation = FRotator(WheelSpeedOffset * WheelSpeed * -1.0, 0, 0);
+	}
 
-void UTankAnimInstance::UpdateWheels()
-{
-	WheelRotation = FRotator(WheelSpeedOffset * WheelSpeed * -1.0, 0, 0);
-}
-
-void UTankAnimInstance::UpdateHatches()
-{
-	HatchRotation = FRotator(HatchAngle, 0, 0);
-}
+	if (bUpdateHatches)
+		HatchRotation = FRotator(HatchAngle, 0, 0);
 
-void UTankAnimInstance::UpdateTurret()
-{
 	TurretRotation = FRotator(0, TurretAngle, 0);
 	GunRotation = FRotator(GunElevation, 0, 0);
 }
 
-void UTankAnimInstance::MC_SetGunElevation_Implementation(const double NewGunElevation)
+FAnimInstanceProxy* UTankAnimInstance::CreateAnimInstanceProxy()
 {
-	GunElevation = NewGunElevation;
+	return new FTankAnimInstanceProxy(this);
 }
 
-void UTankAnimInstance::SR_SetGunElevation_Implementation(const double NewGunElevation)
+void UTankAnimInstance::DestroyAnimInstanceProxy(FAnimInstanceProxy* InProxy)
 {
-	MC_SetGunElevation(NewGunElevation);
+	delete static_cast<FTankAnimInstanceProxy*>(InProxy);
 }
 
-void UTankAnimInstance::MC_UpdateTracksMaterial_Implementation()
+void UTankAnimInstance::NativeInitializeAnimation()
 {
-	UpdateTracksMaterial();
-}
+	Super::NativeInitializeAnimation();
 
-void UTankAnimInstance::MC_UpdateWheels_Implementation()
-{
-	UpdateWheels();
+	// the vehicle anim instance only hands the movement component to its own proxy, which is replaced by ours
+	if (AActor* Actor = GetOwningActor())
+		GetProxyOnGameThread<FTankAnimInstanceProxy>().SetWheeledVehicleComponent(Actor->FindComponentByClass<UChaosWheeledVehicleMovementComponent>());
 }
 
-void UTankAnimInstance::MC_UpdateHatches_Implementation()
+void UTankAnimInstance::NativeUpdateAnimation(float DeltaSeconds)
 {
-	UpdateHatches();
+	Super::NativeUpdateAnimation(DeltaSeconds);
+
+	// material parameters can only be written on the game thread. the pose math is done by FTankAnimInstanceProxy
+	if (bUpdateWheelsAndTracks)
+		UpdateTracksMaterial();
 }
 
-void UTankAnimInstance::MC_UpdateTurret_Implementation()
+void UTankAnimInstance::NativeThreadSafeUpdateAnimation(float DeltaSeconds)
 {
-	UpdateTurret();
+	Super::NativeThreadSafeUpdateAnimation(DeltaSeconds);
+
+	const FTankAnimInstanceProxy& Proxy = GetProxyOnAnyThread<FTankAnimInstanceProxy>();
+	WheelSpeedOffset = Proxy.WheelSpeedOffset;
+	WheelRotation = Proxy.WheelRotation;
+	HatchRotation = Proxy.HatchRotation;
+	TurretRotation = Proxy.TurretRotation;
+	GunRotation = Proxy.GunRotation;
 }
 
-void UTankAnimInstance::SR_UpdateWheels_Implementation()
+void UTankAnimInstance::UpdateSpeedOffset(const double Increment)
 {
-	MC_UpdateWheels();
+	WheelSpeedOffset = UKismetMathLibrary::GenericPercent_FloatFloat(Increment + WheelSpeedOffset, 360.0);
 }
 
-void UTankAnimInstance::SR_UpdateHatches_Implementation()
+void UTankAnimInstance::UpdateWheels()
 {
-	MC_UpdateHatches();
+	WheelRotation = FRotator(WheelSpeedOffset * WheelSpeed * -1.0, 0, 0);
 }
 
-void UTankAnimInstance::SR_UpdateTurret_Implementation()
+void UTankAnimInstance::UpdateHatches()
 {
-	MC_UpdateTurret();
+	HatchRotation = FRotator(HatchAngle, 0, 0);
 }
 
-void UTankAnimInstance::SR_UpdateTracksMaterial_Implementation()
+void UTankAnimInstance::UpdateTurret()
 {
-	MC_UpdateTracksMaterial();
+	TurretRotation = FRotator(0, TurretAngle, 0);
+	GunRotation = FRotator(GunElevation, 0, 0);
 }
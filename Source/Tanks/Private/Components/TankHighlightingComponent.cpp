@@ -4,10 +4,8 @@
 #include "Components/TankHighlightingComponent.h"
 
 #include "TankCharacter.h"
-#include "GameFramework/TankGameState.h"
 #include "GameFramework/TankPlayerState.h"
-#include "Kismet/GameplayStatics.h"
-#include "Kismet/KismetSystemLibrary.h"
+#include "Subsystems/TankSpatialHashSubsystem.h"
 
 
 void UTankHighlightingComponent::SetDefaults()
@@ -31,9 +29,8 @@ UTankHighlightingComponent::UTankHighlightingComponent(): BoxTraceZOffset(0),
                                                           HorizontalLineTraceHalfSize(FVector(10, 100, 10)),
                                                           FriendHighlightingThreshold(20000)
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
+	// ticked by ATankCharacter through its Highlighting tick task
+	PrimaryComponentTick.bCanEverTick = false;
 
 }
 
@@ -49,134 +46,87 @@ void UTankHighlightingComponent::HighlightFriendlyTanks()
 	if (!TankCharacter)
 		return;
 
-	if (!UGameplayStatics::GetGameState(GetWorld()))
-		return;
-	
-	ATankGameState* TankGameState = Cast<ATankGameState>(UGameplayStatics::GetGameState(GetWorld()));
-	if (!TankGameState)
+	auto SpatialHash = GetWorld()->GetSubsystem<UTankSpatialHashSubsystem>();
+	if (!SpatialHash)
 		return;
 
-	if (TankGameState->Teams.IsEmpty())
-		return;
+	const ATankPlayerState* TankPlayerState = TankCharacter->GetPlayerState<ATankPlayerState>();
+	const ETeam CurrentTeam = TankPlayerState ? TankPlayerState->GetCurrentTeam() : ETeam::Unassigned;
 
-	ETeam CurrentTeam;
+	TArray<ATankCharacter*> InRange;
+	SpatialHash->QueryTeamInRange(CurrentTeam, TankCharacter->GetActorLocation(), FriendHighlightingThreshold, InRange, TankCharacter);
 
-	if (auto e = Cast<ATankCharacter>(GetOwner()))
-		CurrentTeam = e->GetPlayerState<ATankPlayerState>()->GetCurrentTeam();
-	else
-		CurrentTeam = ETeam::Unassigned;
+	// went out of range, or changed teams
+	for (auto It = HighlightedFriendlyTanks.CreateIterator(); It; ++It)
+	{
+		ATankCharacter* OtherTank = It->Get();
+		if (OtherTank && InRange.Contains(OtherTank))
+			continue;
 
-	auto Array = TankGameState->GetPlayersInTeam(CurrentTeam);
+		if (OtherTank)
+			ITankInterface::Execute_OutlineTank(OtherTank, false, true);
+		It.RemoveCurrent();
+	}
 
-	for (auto Element : Array.Players)
+	// came into range
+	for (ATankCharacter* OtherTank : InRange)
 	{
-		if (!Element)
-			continue;
-		
-		if (Element == TankCharacter->GetPlayerState())
+		if (HighlightedFriendlyTanks.Contains(OtherTank))
 			continue;
 
-		auto OtherTank = Cast<ATankCharacter>(Element->GetPawn());
-		
-		if (OtherTank)
-		{
-			auto DistanceToOtherTank = FVector::Distance(OtherTank->GetActorLocation(), TankCharacter->GetActorLocation());
-
-			if (DistanceToOtherTank > FriendHighlightingThreshold)
-			{
-				ITankInterface::Execute_OutlineTank(OtherTank, false, true);
-			}
-			else
-			{
-				ITankInterface::Execute_OutlineTank(OtherTank, true, true);
-			}
-		}
+		ITankInterface::Execute_OutlineTank(OtherTank, true, true);
+		HighlightedFriendlyTanks.Add(OtherTank);
 	}
 }
 
 void UTankHighlightingComponent::HighlightEnemyTanksIfDetected_Implementation()
 {
-	CurrentHitResults.Empty();
+	if (!TankCharacter)
+		return;
+
+	auto SpatialHash = GetWorld()->GetSubsystem<UTankSpatialHashSubsystem>();
+	if (!SpatialHash)
+		return;
 
-	FVector Start = TankCharacter->GetMesh()->GetSocketTransform("GunShootSocket").GetLocation();
+	const FTransform GunTransform = TankCharacter->GetMesh()->GetSocketTransform("GunShootSocket");
+	const FQuat GunRotation = GunTransform.GetRotation();
+
+	FVector Start = GunTransform.GetLocation();
 	Start.Z += BoxTraceZOffset;
-	FVector End = Start + TankCharacter->GetMesh()->GetSocketQuaternion("GunShootSocket").GetForwardVector() *
-		BoxTraceLength;
-
-	// horizontal box trace
-	UKismetSystemLibrary::BoxTraceMultiForObjects(
-		GetWorld(),
-		Start,
-		End,
-		HorizontalLineTraceHalfSize,
-		TankCharacter->GetMesh()->GetSocketRotation("GunShootSocket"),
-		{ObjectTypeQuery5},
-		false,
-		{GetOwner()},
-		EDrawDebugTrace::None,
-		HorizontalHits,
-		true,
-		FLinearColor::Yellow
-	);
-
-	// vertical box trace
-	UKismetSystemLibrary::BoxTraceMultiForObjects(
-		GetWorld(),
-		Start,
-		End,
-		VerticalLineTraceHalfSize,
-		TankCharacter->GetMesh()->GetSocketRotation("GunShootSocket"),
-		{ObjectTypeQuery5},
-		false,
-		{GetOwner()},
-		EDrawDebugTrace::None,
-		VerticalHits,
-		true,
-		FLinearColor::Yellow
-	);
+
+	// the volume each of the old box traces swept, a box stretched along the gun
+	const FVector Center = Start + GunRotation.GetForwardVector() * (BoxTraceLength * 0.5);
+	const FVector SweepExtent(BoxTraceLength * 0.5, 0, 0);
+
+	CurrentTanks.Reset();
+	VerticalTanks.Reset();
+
+	SpatialHash->QueryBox(Center, HorizontalLineTraceHalfSize + SweepExtent, GunRotation, CurrentTanks, TankCharacter);
+	SpatialHash->QueryBox(Center, VerticalLineTraceHalfSize + SweepExtent, GunRotation, VerticalTanks, TankCharacter);
 
 	// remove duplicates
-	for (auto& Hit : VerticalHits)
-		if (!CurrentHitResults.Contains(Hit))
-			CurrentHitResults.Add(Hit);
-	for (auto& Hit : HorizontalHits)
-		if (!CurrentHitResults.Contains(Hit))
-			CurrentHitResults.Add(Hit);
-
-	// Removes hit results with actors that are no longer detected by the trace.
+	for (ATankCharacter* Tank : VerticalTanks)
+		CurrentTanks.AddUnique(Tank);
+
+	// Removes tanks that are no longer detected.
 	for (auto It = HighlightedEnemyTanks.CreateIterator(); It; ++It)
 	{
-		if (!CurrentHitResults.Contains(*It) && It->GetActor())
+		if (!CurrentTanks.Contains(*It))
 		{
-			// Actor no longer detected, remove it and remove outline
-			ITankInterface::Execute_OutlineTank(It->GetActor(), false, false);
+			// Tank no longer detected, remove it and remove outline
+			if (*It)
+				ITankInterface::Execute_OutlineTank(*It, false, false);
 			It.RemoveCurrent();
 		}
 	}
 
-	// add any hit results that were previously not present
-	for (const FHitResult& Element : CurrentHitResults)
-		if (!HighlightedEnemyTanks.Contains(Element))
-			HighlightedEnemyTanks.Add(Element);
-
-	// highlight any and all actors that implement the interface
-	for (const FHitResult& Hit : HighlightedEnemyTanks)
-		if (Hit.IsValidBlockingHit())
-			if (Hit.GetActor())
-				if (Hit.GetActor()->GetClass()->ImplementsInterface(UTankInterface::StaticClass()))
-					ITankInterface::Execute_OutlineTank(Hit.GetActor(), true, false);
-}
-
-void UTankHighlightingComponent::TickComponent(float DeltaTime, ELevelTick TickType,
-                                               FActorComponentTickFunction* ThisTickFunction)
-{
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-
-	if (!TankCharacter)
-		return;
+	// outline only the tanks that were previously not present
+	for (ATankCharacter* Tank : CurrentTanks)
+	{
+		if (HighlightedEnemyTanks.Contains(Tank))
+			continue;
 
-	if (!TankCharacter->IsLocallyControlled())
-		return;
-	
-	HighlightEnemyTanksIfDetected();
+		ITankInterface::Execute_OutlineTank(Tank, true, false);
+		HighlightedEnemyTanks.Add(Tank);
+	}
 }
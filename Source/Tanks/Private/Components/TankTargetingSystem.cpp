@@ -5,6 +5,7 @@
 
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "Libraries/TankDebugDraw.h"
 
 UTankTargetingSystem::UTankTargetingSystem(): LockAcquireTime(0.5f), LockLoseTime(0.5f),
                                               LockedTarget(nullptr),
@@ -46,14 +47,7 @@ void UTankTargetingSystem::DebugSphereAboveActor(const AActor* Actor, const FCol
 	
 	const FVector Start = Actor->GetActorLocation() + FVector(0,0, 1000) + Offset;
 
-	DrawDebugSphere(
-		GetWorld(),
-		Start,
-		200,
-		16,
-		Color,
-		false, 0
-	);
+	TankDebugDraw::Sphere(GetWorld(), ETankDebugDrawChannel::Targeting, Start, 200, 16, Color);
 }
 
 AActor* UTankTargetingSystem::FindClosestTarget(const TArray<AActor*>& HitResults) const
@@ -81,8 +75,9 @@ AActor* UTankTargetingSystem::FindClosestTarget(const TArray<AActor*>& HitResult
 	// Optionally print timing here if profiling
 	double EndTime = FPlatformTime::Seconds();
 	double Duration = (EndTime - StartTime) * 1000.0;
-	UKismetSystemLibrary::PrintString(
-		GetWorld(), FString::Printf(TEXT("FindClosestTarget: %.3f ms"), Duration), true, false, FLinearColor::Green, 0);
+	if (TankDebugDraw::IsChannelEnabled(ETankDebugDrawChannel::Targeting))
+		UKismetSystemLibrary::PrintString(
+			GetWorld(), FString::Printf(TEXT("FindClosestTarget: %.3f ms"), Duration), true, false, FLinearColor::Green, 0);
 
 	// will be null only if HitResults is empty
 	return ClosestActor;
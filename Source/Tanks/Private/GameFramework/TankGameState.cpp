@@ -21,6 +21,8 @@ void ATankGameState::BeginPlay()
 {
 	Super::BeginPlay();
 
+	// spawned here and not in OnConstruction, which runs more than once and threw away a fully built pool each time
+	SpawnProjectilePool();
 }
 
 void ATankGameState::OnRep_Teams()
@@ -29,6 +31,9 @@ void ATankGameState::OnRep_Teams()
 
 void ATankGameState::SpawnProjectilePool()
 {
+	if (UKismetSystemLibrary::IsValid(ProjectilePool))
+		return;
+
 	RemoveAllProjectilePools();
 
 	auto SpawnLocation = FVector::ZeroVector;
@@ -62,13 +67,6 @@ void ATankGameState::RemoveAllProjectilePools() const
 			OutActor->Destroy();
 }
 
-void ATankGameState::OnConstruction(const FTransform& Transform)
-{
-	Super::OnConstruction(Transform);
-
-	SpawnProjectilePool();
-}
-
 void ATankGameState::AssignPlayerToTeam(APlayerState* NewPlayer)
 {
 	if (!UKismetSystemLibrary::IsValid(NewPlayer))
@@ -0,0 +1,55 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GameFramework/TankTickSettings.h"
+
+ETankTickTier FTankTickTiers::GetTier(const ETankTickTask Task) const
+{
+	switch (Task)
+	{
+	case ETankTickTask::CameraTrace:		return CameraTrace;
+	case ETankTickTask::TurretTrace:		return TurretTrace;
+	case ETankTickTask::TurretTurning:		return TurretTurning;
+	case ETankTickTask::GunElevation:		return GunElevation;
+	case ETankTickTask::BarrelClearance:	return BarrelClearance;
+	case ETankTickTask::CameraPitchLimits:	return CameraPitchLimits;
+	case ETankTickTask::ConeTrace:			return ConeTrace;
+	case ETankTickTask::AimAssist:			return AimAssist;
+	case ETankTickTask::GunSight:			return GunSight;
+	case ETankTickTask::Highlighting:		return Highlighting;
+	default:								return ETankTickTier::EveryFrame;
+	}
+}
+
+UTankTickSettings::UTankTickSettings()
+{
+	// the clearance checks and the outlines do not need to react within a frame
+	ClientTiers.BarrelClearance = ETankTickTier::Hz10;
+	ClientTiers.CameraPitchLimits = ETankTickTier::Hz10;
+	ClientTiers.ConeTrace = ETankTickTier::Hz30;
+	ClientTiers.Highlighting = ETankTickTier::Hz10;
+
+	// nobody looks through the server's copy of a remote tank
+	ServerTiers.CameraTrace = ETankTickTier::Hz30;
+	ServerTiers.TurretTrace = ETankTickTier::Hz30;
+	// the owner sends its turret and gun angles with SR_SetAimState
+	ServerTiers.TurretTurning = ETankTickTier::OnEvent;
+	ServerTiers.GunElevation = ETankTickTier::OnEvent;
+	ServerTiers.BarrelClearance = ETankTickTier::Hz10;
+	ServerTiers.CameraPitchLimits = ETankTickTier::OnEvent;
+	ServerTiers.ConeTrace = ETankTickTier::Hz10;
+	ServerTiers.AimAssist = ETankTickTier::Hz30;
+	// the gun sight is only updated on the owning client
+	ServerTiers.GunSight = ETankTickTier::OnEvent;
+	ServerTiers.Highlighting = ETankTickTier::OnEvent;
+}
+
+float UTankTickSettings::GetTierInterval(const ETankTickTier Tier)
+{
+	switch (Tier)
+	{
+	case ETankTickTier::Hz30:	return 1.0f / 30.0f;
+	case ETankTickTier::Hz10:	return 1.0f / 10.0f;
+	default:					return 0.0f;
+	}
+}
@@ -4,8 +4,9 @@
 #include "Libraries/TFL.h"
 
 #include "Engine/DamageEvents.h"
-#include "Engine/OverlapResult.h"
 #include "Kismet/GameplayStatics.h"
+#include "Subsystems/TankSpatialHashSubsystem.h"
+#include "TankCharacter.h"
 
 /** Also ripped from UGameplayStatics.
  * @RETURN True if weapon trace from Origin hits component VictimComp.  OutHitResult will contain properties of the hit. */
@@ -67,32 +68,25 @@ bool UTFL::ApplyRadialDamageWithFalloff(const UObject* WorldContextObject, float
                                         AActor* DamageCauser, AController* InstigatedByController, ECollisionChannel DamagePreventionChannel)
 {
 	HitActors.Empty();
-	FCollisionQueryParams SphereParams(SCENE_QUERY_STAT(ApplyRadialDamage),  false, DamageCauser);
 
-	SphereParams.AddIgnoredActors(IgnoreActors);
-
-	// query scene to see what we hit
-	TArray<FOverlapResult> Overlaps;
+	// only tanks take damage, so they come from the spatial hash instead of the physics scene
+	TArray<ATankCharacter*> Tanks;
 	if (UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull))
-	{
-		World->OverlapMultiByObjectType(Overlaps, Origin, FQuat::Identity, FCollisionObjectQueryParams(FCollisionObjectQueryParams::InitType::AllDynamicObjects), FCollisionShape::MakeSphere(DamageOuterRadius), SphereParams);
-	}
+		if (auto SpatialHash = World->GetSubsystem<UTankSpatialHashSubsystem>())
+			SpatialHash->QueryRadius(Origin, DamageOuterRadius, Tanks, DamageCauser);
 
 	// collate into per-actor list of hit components
 	TMap<AActor*, TArray<FHitResult> > OverlapComponentMap;
-	for (const FOverlapResult& Overlap : Overlaps)
+	for (ATankCharacter* Tank : Tanks)
 	{
-		AActor* const OverlapActor = Overlap.OverlapObjectHandle.FetchActor();
-
-		if (OverlapActor &&
-			OverlapActor->CanBeDamaged() &&
-			OverlapActor != DamageCauser &&
-			Overlap.Component.IsValid())
+		if (Tank->CanBeDamaged() &&
+			!IgnoreActors.Contains(Tank) &&
+			Tank->GetMesh())
 		{
 			FHitResult Hit;
-			if (ComponentIsDamageableFrom(Overlap.Component.Get(), Origin, DamageCauser, IgnoreActors, DamagePreventionChannel, Hit))
+			if (ComponentIsDamageableFrom(Tank->GetMesh(), Origin, DamageCauser, IgnoreActors, DamagePreventionChannel, Hit))
 			{
-				TArray<FHitResult>& HitList = OverlapComponentMap.FindOrAdd(OverlapActor);
+				TArray<FHitResult>& HitList = OverlapComponentMap.FindOrAdd(Tank);
 				HitList.Add(Hit);
 			}
 		}
@@ -126,3 +120,107 @@ bool UTFL::ApplyRadialDamageWithFalloff(const UObject* WorldContextObject, float
 
 	return bAppliedDamage;
 }
+
+/** Appends the tanks from the spatial hash that are inside the cone and not ignored */
+static void QueryConeTanks(const UWorld* World, const FVector& Origin, const FVector& Direction, const float Length,
+                           const float StartRadius, const float EndRadius, const TFunctionRef<bool(const AActor*)> IsIgnored, TArray<AActor*>& OutVehicles)
+{
+	auto SpatialHash = World->GetSubsystem<UTankSpatialHashSubsystem>();
+	if (!SpatialHash)
+		return;
+
+	TArray<ATankCharacter*, TInlineAllocator<16>> Tanks;
+	SpatialHash->QueryCone(Origin, Direction, Length, StartRadius, EndRadius, Tanks);
+
+	for (ATankCharacter* Tank : Tanks)
+		if (!IsIgnored(Tank))
+			OutVehicles.Add(Tank);
+}
+
+static FCollisionObjectQueryParams GetConeBlockerParams()
+{
+	FCollisionObjectQueryParams BlockerParams;
+	BlockerParams.AddObjectTypesToQuery(ECC_WorldStatic);
+	BlockerParams.AddObjectTypesToQuery(ECC_WorldDynamic);
+	return BlockerParams;
+}
+
+float UTFL::ConeOverlapVehicles(const UObject* WorldContextObject, const FVector& Origin, const FVector& Direction, float Length,
+                                const float StartRadius, const float EndRadius, const TArray<AActor*>& IgnoreActors, TArray<AActor*>& OutVehicles)
+{
+	OutVehicles.Reset();
+
+	UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull);
+	if (!World || Length <= 0)
+		return 0;
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ConeOverlapVehicles), false);
+	QueryParams.AddIgnoredActors(IgnoreActors);
+
+	// nothing behind a wall can be targeted, so the cone stops at the first non-vehicle on its axis
+	FHitResult BlockingHit;
+	if (World->LineTraceSingleByObjectType(BlockingHit, Origin, Origin + Direction * Length, GetConeBlockerParams(), QueryParams))
+		Length = BlockingHit.Distance;
+
+	QueryConeTanks(World, Origin, Direction, Length, StartRadius, EndRadius,
+	               [&IgnoreActors](const AActor* Actor) { return IgnoreActors.Contains(Actor); }, OutVehicles);
+
+	return Length;
+}
+
+FConeQueryHandle UTFL::RequestConeOverlapVehiclesAsync(const UObject* WorldContextObject, const FVector& Origin, const FVector& Direction,
+                                                      const float Length, const float StartRadius, const float EndRadius, const TArray<AActor*>& IgnoreActors)
+{
+	FConeQueryHandle Handle;
+
+	UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull);
+	if (!World || Length <= 0)
+		return Handle;
+
+	Handle.Origin = Origin;
+	Handle.Direction = Direction;
+	Handle.Length = Length;
+	Handle.StartRadius = StartRadius;
+	Handle.EndRadius = EndRadius;
+
+	for (AActor* Actor : IgnoreActors)
+		Handle.IgnoreActors.Add(Actor);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ConeOverlapVehiclesAsync), false);
+	QueryParams.AddIgnoredActors(IgnoreActors);
+
+	// the tanks are taken from the spatial hash once the blocker is known
+	Handle.AxisTrace = World->AsyncLineTraceByObjectType(EAsyncTraceType::Single, Origin, Origin + Direction * Length,
+	                                                     GetConeBlockerParams(), QueryParams);
+
+	return Handle;
+}
+
+bool UTFL::ConsumeConeOverlapVehicles(const UObject* WorldContextObject, FConeQueryHandle& Handle, TArray<AActor*>& OutVehicles, float& OutLength)
+{
+	UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull);
+	if (!World || !Handle.IsValid())
+		return false;
+
+	FTraceDatum AxisData;
+
+	if (!World->QueryTraceData(Handle.AxisTrace, AxisData))
+	{
+		// results are only kept for one frame
+		if (!World->IsTraceHandleValid(Handle.AxisTrace, false))
+			Handle = FConeQueryHandle();
+		return false;
+	}
+
+	OutLength = Handle.Length;
+	for (const FHitResult& Hit : AxisData.OutHits)
+		if (Hit.bBlockingHit)
+			OutLength = FMath::Min(OutLength, static_cast<float>(Hit.Distance));
+
+	OutVehicles.Reset();
+	QueryConeTanks(World, Handle.Origin, Handle.Direction, OutLength, Handle.StartRadius, Handle.EndRadius,
+	               [&Handle](const AActor* Actor) { return Handle.IgnoreActors.Contains(Actor); }, OutVehicles);
+
+	Handle = FConeQueryHandle();
+	return true;
+}
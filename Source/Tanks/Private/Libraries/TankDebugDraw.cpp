@@ -0,0 +1,166 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Libraries/TankDebugDraw.h"
+
+#if TANK_DEBUG_DRAW
+
+#include "DrawDebugHelpers.h"
+#include "Components/LineBatchComponent.h"
+
+namespace TankDebugDraw
+{
+	static TAutoConsoleVariable<bool> CVarDrawProjectiles(
+		TEXT("tank.Debug.Projectiles"), false,
+		TEXT("Draws a sphere around every projectile in flight."));
+
+	static TAutoConsoleVariable<bool> CVarDrawTargeting(
+		TEXT("tank.Debug.Targeting"), false,
+		TEXT("Draws the pending and locked target of the targeting system and prints its timing."));
+
+	static TAutoConsoleVariable<bool> CVarDrawConeTrace(
+		TEXT("tank.Debug.ConeTrace"), true,
+		TEXT("Draws the cone trace spheres. Still needs bShowDebugTracesForTurret on the tank."));
+
+	static TAutoConsoleVariable<bool> CVarDrawSpawnPoints(
+		TEXT("tank.Debug.SpawnPoints"), false,
+		TEXT("Draws the spawn point used on respawn and the ground trace when the tank is reset."));
+
+	static TAutoConsoleVariable<bool> CVarDrawTurretTraces(
+		TEXT("tank.Debug.TurretTraces"), true,
+		TEXT("Draws the async camera, turret and barrel traces. Still needs bShowDebugTracesForTurret on the tank."));
+
+	static TAutoConsoleVariable<bool> CVarDrawSignificance(
+		TEXT("tank.Debug.Significance"), false,
+		TEXT("Shows the significance bucket and animation tick rate above every tank."));
+
+	static TAutoConsoleVariable<bool> CVarDrawGunElevation(
+		TEXT("tank.Debug.GunElevation"), false,
+		TEXT("Prints the camera and turret aim points and the gun elevation they give on screen."));
+
+	static const TAutoConsoleVariable<bool>* Channels[] =
+	{
+		&CVarDrawProjectiles,
+		&CVarDrawTargeting,
+		&CVarDrawConeTrace,
+		&CVarDrawSpawnPoints,
+		&CVarDrawTurretTraces,
+		&CVarDrawSignificance,
+		&CVarDrawGunElevation,
+	};
+	static_assert(UE_ARRAY_COUNT(Channels) == static_cast<int32>(ETankDebugDrawChannel::Num), "Every channel needs a console variable");
+
+	/** Lines waiting to be handed to a world's line batcher at the end of the frame */
+	struct FPendingLines
+	{
+		TArray<FBatchedLine> Lines;
+		TArray<FBatchedLine> PersistentLines;
+	};
+
+	static TMap<TObjectKey<UWorld>, FPendingLines> PendingLinesPerWorld;
+	static FDelegateHandle FlushHandle;
+
+	static void Flush(UWorld* World, ELevelTick, float)
+	{
+		FPendingLines* Pending = PendingLinesPerWorld.Find(World);
+		if (!Pending)
+			return;
+
+		if (!Pending->Lines.IsEmpty())
+			if (ULineBatchComponent* LineBatcher = World->GetLineBatcher(UWorld::ELineBatcherType::World))
+				LineBatcher->DrawLines(Pending->Lines);
+
+		if (!Pending->PersistentLines.IsEmpty())
+			if (ULineBatchComponent* LineBatcher = World->GetLineBatcher(UWorld::ELineBatcherType::WorldPersistent))
+				LineBatcher->DrawLines(Pending->PersistentLines);
+
+		PendingLinesPerWorld.Remove(World);
+	}
+
+	static TArray<FBatchedLine>& GetPendingLines(const UWorld* World, const bool bPersistent)
+	{
+		if (!FlushHandle.IsValid())
+			FlushHandle = FWorldDelegates::OnWorldPostActorTick.AddStatic(&Flush);
+
+		FPendingLines& Pending = PendingLinesPerWorld.FindOrAdd(World);
+		return bPersistent ? Pending.PersistentLines : Pending.Lines;
+	}
+
+	bool IsChannelEnabled(const ETankDebugDrawChannel Channel)
+	{
+		return Channels[static_cast<int32>(Channel)]->GetValueOnGameThread();
+	}
+
+	void Sphere(const UWorld* World, const ETankDebugDrawChannel Channel, const FVector& Center, const float Radius,
+	            int32 Segments, const FColor& Color, const bool bPersistent)
+	{
+		if (!World || World->GetNetMode() == NM_DedicatedServer || !IsChannelEnabled(Channel))
+			return;
+
+		// same rings as DrawDebugSphere, but added to the frame's batch
+		Segments = FMath::Max(Segments, 4);
+		const float AngleInc = 2.f * UE_PI / Segments;
+		const float LifeTime = bPersistent ? -1.f : 0.f;
+
+		TArray<FBatchedLine>& Lines = GetPendingLines(World, bPersistent);
+		Lines.Reserve(Lines.Num() + Segments * Segments * 2);
+
+		float Latitude = AngleInc;
+		float SinY1 = 0.0f, CosY1 = 1.0f;
+
+		for (int32 NumSegmentsY = Segments; NumSegmentsY > 0; --NumSegmentsY)
+		{
+			const float SinY2 = FMath::Sin(Latitude);
+			const float CosY2 = FMath::Cos(Latitude);
+
+			FVector Vertex1 = FVector(SinY1, 0.0f, CosY1) * Radius + Center;
+			FVector Vertex3 = FVector(SinY2, 0.0f, CosY2) * Radius + Center;
+			float Longitude = AngleInc;
+
+			for (int32 NumSegmentsX = Segments; NumSegmentsX > 0; --NumSegmentsX)
+			{
+				const float SinX = FMath::Sin(Longitude);
+				const float CosX = FMath::Cos(Longitude);
+
+				const FVector Vertex2 = FVector(CosX * SinY1, SinX * SinY1, CosY1) * Radius + Center;
+				const FVector Vertex4 = FVector(CosX * SinY2, SinX * SinY2, CosY2) * Radius + Center;
+
+				Lines.Emplace(Vertex1, Vertex2, Color, LifeTime, 0.f, SDPG_World);
+				Lines.Emplace(Vertex1, Vertex3, Color, LifeTime, 0.f, SDPG_World);
+
+				Vertex1 = Vertex2;
+				Vertex3 = Vertex4;
+				Longitude += AngleInc;
+			}
+
+			SinY1 = SinY2;
+			CosY1 = CosY2;
+			Latitude += AngleInc;
+		}
+	}
+
+	void Line(const UWorld* World, const ETankDebugDrawChannel Channel, const FVector& Start, const FVector& End,
+	          const FColor& Color, const bool bPersistent)
+	{
+		if (!World || World->GetNetMode() == NM_DedicatedServer || !IsChannelEnabled(Channel))
+			return;
+
+		GetPendingLines(World, bPersistent).Emplace(Start, End, Color, bPersistent ? -1.f : 0.f, 0.f, SDPG_World);
+	}
+
+	void String(const UWorld* World, const ETankDebugDrawChannel Channel, const FVector& Location, const FString& Text,
+	            const FColor& Color, const float Duration)
+	{
+		if (!World || World->GetNetMode() == NM_DedicatedServer || !IsChannelEnabled(Channel))
+			return;
+
+		DrawDebugString(World, Location, Text, nullptr, Color, Duration, true);
+	}
+
+	EDrawDebugTrace::Type TraceType(const ETankDebugDrawChannel Channel, const EDrawDebugTrace::Type Requested)
+	{
+		return IsChannelEnabled(Channel) ? Requested : EDrawDebugTrace::None;
+	}
+}
+
+#endif
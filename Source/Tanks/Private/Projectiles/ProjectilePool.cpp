@@ -3,16 +3,38 @@
 
 #include "Projectiles/ProjectilePool.h"
 
+#include "GameFramework/GameStateBase.h"
+#include "GameFramework/ProjectileMovementComponent.h"
 #include "Kismet/GameplayStatics.h"
+#include "Libraries/TankDebugDraw.h"
 #include "Projectiles/TankProjectile.h"
+#include "Subsystems/TankBallisticsSubsystem.h"
 
+DECLARE_STATS_GROUP(TEXT("ProjectilePool"), STATGROUP_ProjectilePool, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Acquire"), STAT_ProjectilePoolAcquire, STATGROUP_ProjectilePool);
+DECLARE_CYCLE_STAT(TEXT("Release"), STAT_ProjectilePoolRelease, STATGROUP_ProjectilePool);
+DECLARE_CYCLE_STAT(TEXT("Expire"), STAT_ProjectilePoolExpire, STATGROUP_ProjectilePool);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Available"), STAT_ProjectilePoolAvailable, STATGROUP_ProjectilePool);
+DECLARE_DWORD_COUNTER_STAT(TEXT("In Use"), STAT_ProjectilePoolInUse, STATGROUP_ProjectilePool);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pending Spawns"), STAT_ProjectilePoolPending, STATGROUP_ProjectilePool);
+DECLARE_DWORD_COUNTER_STAT(TEXT("High Water"), STAT_ProjectilePoolHighWater, STATGROUP_ProjectilePool);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Misses"), STAT_ProjectilePoolMisses, STATGROUP_ProjectilePool);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Grows"), STAT_ProjectilePoolGrows, STATGROUP_ProjectilePool);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Trimmed"), STAT_ProjectilePoolTrimmed, STATGROUP_ProjectilePool);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Expiry Heap"), STAT_ProjectilePoolExpiryHeap, STATGROUP_ProjectilePool);
 
 // Sets default values
-AProjectilePool::AProjectilePool(): PoolSize(20)
+AProjectilePool::AProjectilePool(): PoolSize(20), WarmUpSpawnsPerTick(4), WarmUpBudgetMs(2.0f), bUseBallisticsSubsystem(false), MaxFastForwardTime(0.3f), MaxPoolSize(200), GrowthChunkSize(10),
+                                    GrowthHighWaterRatio(0.8f), MaxSpawnsPerFrame(2), bSpawnOnMiss(true),
+                                    TrimCooldown(30.0f), TrimLowWaterRatio(0.25f), MaxTrimsPerFrame(1),
+                                    PendingSpawns(0), LastBusyTime(0), WarmUpRemaining(0), WarmUpFrames(0),
+                                    WarmUpSpawnTime(0), WarmUpStartTime(0)
 {
 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
+	// every machine spawns its own pool, see ATankGameState::BeginPlay
+	bReplicates = false;
 }
 
 AProjectilePool::~AProjectilePool()
@@ -29,29 +51,170 @@ void AProjectilePool::BeginPlay()
 	InitPool();
 }
 
+void AProjectilePool::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+
+	UE_LOG(LogTemp, Log, TEXT("(AProjectilePool::EndPlay) %s: Pooled %d, HighWater %d, Misses %d, Grows %d, Trimmed %d"),
+	       *GetName(), GetNumPooled(), Stats.HighWater, Stats.Misses, Stats.Grows, Stats.Trimmed);
+}
+
 void AProjectilePool::InitPool()
+{
+	PooledActors.Reserve(PoolSize);
+	SlotGenerations.Reserve(PoolSize);
+	FreeIndices.Reserve(PoolSize);
+	ExpiryHeap.Reserve(PoolSize);
+	LastBusyTime = GetWorld()->GetTimeSeconds();
+
+	// spawning every projectile here hitches the map load, so it is spread over the next ticks instead.
+	// shells simulated by the ballistics subsystem do not need any actors
+	WarmUpRemaining = bUseBallisticsSubsystem ? 0 : FMath::Min(PoolSize, MaxPoolSize);
+	WarmUpFrames = 0;
+	WarmUpSpawnTime = 0;
+	WarmUpStartTime = FPlatformTime::Seconds();
+}
+
+void AProjectilePool::ProcessWarmUp()
+{
+	if (!IsWarmingUp())
+		return;
+
+	const double FrameStartTime = FPlatformTime::Seconds();
+	const double BudgetSeconds = WarmUpBudgetMs / 1000.0;
+
+	for (int32 i = 0; i < WarmUpSpawnsPerTick && WarmUpRemaining > 0; ++i)
+	{
+		--WarmUpRemaining;
+
+		// shots fired during warm-up might have already spawned some on a miss
+		if (GetNumPooled() < PoolSize)
+			SpawnPooledProjectile();
+
+		if (FPlatformTime::Seconds() - FrameStartTime >= BudgetSeconds)
+			break;
+	}
+
+	WarmUpSpawnTime += FPlatformTime::Seconds() - FrameStartTime;
+	++WarmUpFrames;
+
+	if (!IsWarmingUp())
+	{
+		UE_LOG(LogTemp, Log, TEXT("(AProjectilePool::ProcessWarmUp) %s warmed up %d projectiles in %.3f ms of spawning over %d frames (%.3f ms wall clock)"),
+		       *GetName(), GetNumPooled(), WarmUpSpawnTime * 1000.0, WarmUpFrames,
+		       (FPlatformTime::Seconds() - WarmUpStartTime) * 1000.0);
+	}
+}
+
+ATankProjectile* AProjectilePool::SpawnPooledProjectile()
 {
 	const FVector SpawnLocation = FVector(0, 0, -10000); // -10,000
 	const FRotator SpawnRotation = FRotator(0);
-	
-	for (int i = 0; i < PoolSize; ++i)
+
+	auto SpawnedActor = GetWorld()->SpawnActorDeferred<ATankProjectile>(
+		ProjectileClass,
+		FTransform(SpawnRotation, SpawnLocation),
+		nullptr, nullptr,
+		ESpawnActorCollisionHandlingMethod::AlwaysSpawn
+	);
+
+	if (!SpawnedActor)
+		return nullptr;
+
+	// reuse a slot freed by trimming before growing the array
+	const int32 Index = EmptySlots.IsEmpty() ? PooledActors.AddDefaulted() : EmptySlots.Pop(EAllowShrinking::No);
+	if (!SlotGenerations.IsValidIndex(Index))
+		SlotGenerations.Add(0);
+
+	SpawnedActor->SetProjectilePool(this);
+	SpawnedActor->SetPoolIndex(Index);
+
+	// shells travel as FProjectileSpawnParams, the net driver never has to look at pooled actors.
+	// forced here as well in case the Blueprint turned replication on
+	SpawnedActor->SetReplicates(false);
+	UGameplayStatics::FinishSpawningActor(SpawnedActor, FTransform());
+
+	PooledActors[Index] = SpawnedActor;
+	FreeIndices.Push(Index);
+
+	return SpawnedActor;
+}
+
+void AProjectilePool::RequestGrowth()
+{
+	// a chunk is already on its way, or the pool has not reached its initial size yet
+	if (PendingSpawns > 0 || IsWarmingUp())
+		return;
+
+	const int32 Room = MaxPoolSize - GetNumPooled();
+	if (Room <= 0)
+		return;
+
+	PendingSpawns = FMath::Min(GrowthChunkSize, Room);
+	++Stats.Grows;
+}
+
+void AProjectilePool::ProcessPendingSpawns()
+{
+	for (int32 i = 0; i < MaxSpawnsPerFrame && PendingSpawns > 0; ++i)
+	{
+		--PendingSpawns;
+
+		if (GetNumPooled() >= MaxPoolSize)
+		{
+			PendingSpawns = 0;
+			break;
+		}
+
+		SpawnPooledProjectile();
+	}
+}
+
+void AProjectilePool::TrimIdleProjectiles()
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+
+	if (GetNumInUse() > GetNumPooled() * TrimLowWaterRatio || PendingSpawns > 0 || IsWarmingUp())
 	{
-		FActorSpawnParameters SpawnParameters;
-		SpawnParameters.Owner = this;
-		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-
-		auto SpawnedActor = GetWorld()->SpawnActorDeferred<ATankProjectile>(
-			ProjectileClass,
-			FTransform(SpawnRotation, SpawnLocation),
-			nullptr, nullptr,
-			ESpawnActorCollisionHandlingMethod::AlwaysSpawn
-		);
-
-		SpawnedActor->SetProjectilePool(this);
-		UGameplayStatics::FinishSpawningActor(SpawnedActor, FTransform());
-
-		if (SpawnedActor)
-			PooledActors.AddUnique(SpawnedActor);
+		LastBusyTime = Now;
+		return;
+	}
+
+	if (Now - LastBusyTime < TrimCooldown)
+		return;
+
+	for (int32 i = 0; i < MaxTrimsPerFrame && GetNumPooled() > PoolSize && !FreeIndices.IsEmpty(); ++i)
+	{
+		const int32 Index = FreeIndices.Pop(EAllowShrinking::No);
+
+		if (ATankProjectile* Projectile = PooledActors[Index])
+			Projectile->Destroy();
+
+		PooledActors[Index] = nullptr;
+		EmptySlots.Push(Index);
+		++Stats.Trimmed;
+	}
+}
+
+void AProjectilePool::ExpireProjectiles()
+{
+	SCOPE_CYCLE_COUNTER(STAT_ProjectilePoolExpire);
+
+	const double Now = GetWorld()->GetTimeSeconds();
+
+	while (!ExpiryHeap.IsEmpty() && ExpiryHeap.HeapTop().ExpireTime <= Now)
+	{
+		FProjectileExpiry Expiry;
+		ExpiryHeap.HeapPop(Expiry, EAllowShrinking::No);
+
+		// the slot was reactivated since, this entry belongs to an earlier shot
+		if (SlotGenerations[Expiry.PoolIndex] != Expiry.Generation)
+			continue;
+
+		// null if trimmed, not in use if it already hit something
+		ATankProjectile* Projectile = PooledActors[Expiry.PoolIndex];
+		if (Projectile && Projectile->IsInUse())
+			Projectile->Deactivate();
 	}
 }
 
@@ -59,6 +222,27 @@ void AProjectilePool::InitPool()
 void AProjectilePool::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
+
+	ExpireProjectiles();
+	ProcessWarmUp();
+	ProcessPendingSpawns();
+	TrimIdleProjectiles();
+
+	SET_DWORD_STAT(STAT_ProjectilePoolAvailable, GetNumAvailable());
+	SET_DWORD_STAT(STAT_ProjectilePoolInUse, GetNumInUse());
+	SET_DWORD_STAT(STAT_ProjectilePoolPending, PendingSpawns);
+	SET_DWORD_STAT(STAT_ProjectilePoolHighWater, Stats.HighWater);
+	SET_DWORD_STAT(STAT_ProjectilePoolMisses, Stats.Misses);
+	SET_DWORD_STAT(STAT_ProjectilePoolGrows, Stats.Grows);
+	SET_DWORD_STAT(STAT_ProjectilePoolTrimmed, Stats.Trimmed);
+	SET_DWORD_STAT(STAT_ProjectilePoolExpiryHeap, ExpiryHeap.Num());
+
+#if TANK_DEBUG_DRAW
+	if (TankDebugDraw::IsChannelEnabled(ETankDebugDrawChannel::Projectiles))
+		for (const ATankProjectile* Projectile : PooledActors)
+			if (Projectile && Projectile->IsInUse())
+				TankDebugDraw::Sphere(GetWorld(), ETankDebugDrawChannel::Projectiles, Projectile->GetActorLocation(), 400, 12, FColor::White);
+#endif
 	//
 	// for (auto Element : PooledActors)
 	// {
@@ -69,18 +253,129 @@ void AProjectilePool::Tick(float DeltaTime)
 
 ATankProjectile* AProjectilePool::FindFirstAvailableProjectile_Implementation()
 {
-	for (auto Element : PooledActors)
-		if (!Element->IsInUse())
-			return Element;
-	return nullptr;
+	// O(1). the top of the free list is always an inactive projectile
+	if (FreeIndices.IsEmpty())
+		return nullptr;
+	return PooledActors[FreeIndices.Last()];
+}
+
+void AProjectilePool::AcquireFromFreeList(const ATankProjectile* Projectile)
+{
+	const int32 Index = Projectile->GetPoolIndex();
+
+	if (!FreeIndices.IsEmpty() && FreeIndices.Last() == Index)
+		FreeIndices.Pop(EAllowShrinking::No);
+	else
+		FreeIndices.RemoveSingleSwap(Index, EAllowShrinking::No); // only happens if FindFirstAvailableProjectile is overridden in BP
+}
+
+void AProjectilePool::ReturnToPool(ATankProjectile* Projectile)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ProjectilePoolRelease);
+
+	if (!Projectile || !PooledActors.IsValidIndex(Projectile->GetPoolIndex()))
+		return;
+
+	if (PooledActors[Projectile->GetPoolIndex()] != Projectile)
+		return;
+
+	checkSlow(!FreeIndices.Contains(Projectile->GetPoolIndex()));
+	FreeIndices.Push(Projectile->GetPoolIndex());
+}
+
+double AProjectilePool::GetServerTime() const
+{
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+	return GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+}
+
+ATankProjectile* AProjectilePool::SpawnFromParams(const FProjectileSpawnParams& Params, UObject* Object/* = nullptr*/)
+{
+	// zero for the machine that fired, roughly the latency from it everywhere else
+	const float FastForwardTime = FMath::Clamp(GetServerTime() - Params.ServerTime, 0.0, static_cast<double>(MaxFastForwardTime));
+
+	if (bUseBallisticsSubsystem)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_ProjectilePoolAcquire);
+
+		if (auto Ballistics = GetWorld()->GetSubsystem<UTankBallisticsSubsystem>())
+			Ballistics->FireShell(ProjectileClass, Params.Origin, Params.Direction, Params.Speed, Object, FastForwardTime, Params.ShotId);
+		return nullptr;
+	}
+
+	ATankProjectile* Projectile = SpawnFromPool(FTransform(Params.Direction.Rotation(), Params.Origin), Object, Params.Speed);
+
+	if (Projectile)
+	{
+		Projectile->SetShotId(Params.ShotId);
+		Projectile->FastForward(FastForwardTime);
+
+		// it already flew for FastForwardTime, so it runs out that much sooner. the new generation makes the entry
+		// SpawnFromPool pushed stale, the same as a reactivated slot's
+		if (FastForwardTime > 0 && Projectile->IsInUse())
+		{
+			const int32 Index = Projectile->GetPoolIndex();
+			ExpiryHeap.HeapPush({GetWorld()->GetTimeSeconds() + Projectile->GetTimeToLive() - FastForwardTime, Index, ++SlotGenerations[Index]});
+		}
+	}
+
+	return Projectile;
+}
+
+bool AProjectilePool::StopShot(const UObject* Object, const uint16 ShotId, const FVector& Location)
+{
+	if (bUseBallisticsSubsystem)
+	{
+		auto Ballistics = GetWorld()->GetSubsystem<UTankBallisticsSubsystem>();
+		return Ballistics && Ballistics->StopShell(Object, ShotId, Location);
+	}
+
+	// only happens once per hit, a few tanks' worth of shells are in flight at most
+	for (ATankProjectile* Projectile : PooledActors)
+	{
+		if (Projectile && Projectile->IsInUse() && Projectile->GetShotId() == ShotId && Projectile->GetCallbackObject() == Object)
+		{
+			Projectile->StopAt(Location);
+			return true;
+		}
+	}
+
+	return false;
 }
 
 ATankProjectile* AProjectilePool::SpawnFromPool_Implementation(const FTransform& SpawnTransform, UObject* Object/* = nullptr*/, const double InitialSpeed/* = 50000.0*/)
 {
+	SCOPE_CYCLE_COUNTER(STAT_ProjectilePoolAcquire);
+
+	if (bUseBallisticsSubsystem)
+	{
+		if (auto Ballistics = GetWorld()->GetSubsystem<UTankBallisticsSubsystem>())
+			Ballistics->FireShell(ProjectileClass, SpawnTransform.GetLocation(), SpawnTransform.GetRotation().GetForwardVector(),
+			                      InitialSpeed, Object);
+		return nullptr;
+	}
+
 	auto FirstAvailableProjectile = FindFirstAvailableProjectile();
+
+	if (!FirstAvailableProjectile)
+	{
+		++Stats.Misses;
+		RequestGrowth();
+
+		// the chunk is deferred, so spawn the one we need right now.
+		// during warm-up the shot is always served, the pool just has not caught up yet.
+		if ((bSpawnOnMiss || IsWarmingUp()) && GetNumPooled() < MaxPoolSize)
+			FirstAvailableProjectile = SpawnPooledProjectile();
+	}
 	
 	if (FirstAvailableProjectile)
 	{
+		AcquireFromFreeList(FirstAvailableProjectile);
+
+		Stats.HighWater = FMath::Max(Stats.HighWater, GetNumInUse());
+		if (GetNumInUse() >= FMath::CeilToInt(GetNumPooled() * GrowthHighWaterRatio))
+			RequestGrowth();
+
 		// UKismetSystemLibrary::PrintString(GetWorld(), FString::Printf(TEXT("(AProjectilePool::SpawnFromPool) FindFirstAvailableProjectile: %s"), *FirstAvailableProjectile->GetName()),
 		// 	true, true, FLinearColor::Red, 15);
 		
@@ -88,12 +383,18 @@ ATankProjectile* AProjectilePool::SpawnFromPool_Implementation(const FTransform&
 
 		if (UKismetSystemLibrary::IsValid(Object))
 			FirstAvailableProjectile->SetCallbackObject(Object);
-		
+
+		// Activate launches it at the movement component's InitialSpeed, same speed as a simulated shell
+		FirstAvailableProjectile->GetProjectileMovementComponent()->InitialSpeed = static_cast<float>(InitialSpeed);
 		FirstAvailableProjectile->Activate();
+
+		// a trimmed slot keeps its generation, so stale entries can never match a new projectile
+		const int32 Index = FirstAvailableProjectile->GetPoolIndex();
+		ExpiryHeap.HeapPush({GetWorld()->GetTimeSeconds() + FirstAvailableProjectile->GetTimeToLive(), Index, ++SlotGenerations[Index]});
 	}
 	else
 	{
-		ensureMsgf(0, TEXT("PROJECTILE POOL IS EITHER EMPTY OR FULL %s"), *GetFullName());
+		ensureMsgf(0, TEXT("PROJECTILE POOL IS EITHER EMPTY OR AT MaxPoolSize %s"), *GetFullName());
 	}
 
 	return FirstAvailableProjectile;
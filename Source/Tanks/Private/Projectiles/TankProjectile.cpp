@@ -3,13 +3,14 @@
 
 #include "Projectiles/TankProjectile.h"
 
-#include "NiagaraFunctionLibrary.h"
 #include "Components/ArrowComponent.h"
 #include "Components/SphereComponent.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "Projectiles/ProjectilePool.h"
 #include "Projectiles/ShootingInterface.h"
+#include "Subsystems/TankVFXSubsystem.h"
 
 
 // Sets default values
@@ -18,10 +19,14 @@ ATankProjectile::ATankProjectile(): SphereCollision(CreateDefaultSubobject<USphe
                                     ProjectileMovementComponent(
 	                                    CreateDefaultSubobject<UProjectileMovementComponent>(
 		                                    "ProjectileMovementComponent")),
-                                    bIsInUse(false), TimeToLive(5), bUseSkeletalMesh(false)
+                                    bIsInUse(false), TimeToLive(5), PoolIndex(INDEX_NONE), ShotId(0), bUseSkeletalMesh(false)
 {
-	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// lifetime and debug drawing are handled by AProjectilePool, projectiles never tick
+	PrimaryActorTick.bCanEverTick = false;
+
+	// every machine flies its own copy, see AProjectilePool::SpawnFromParams
+	bReplicates = false;
+	SetReplicatingMovement(false);
 
 	SetRootComponent(SphereCollision);
 	SphereCollision->InitSphereRadius(200);
@@ -49,11 +54,6 @@ ATankProjectile::ATankProjectile(): SphereCollision(CreateDefaultSubobject<USphe
 	CreateMesh();
 }
 
-ATankProjectile::~ATankProjectile()
-{
-	TimerHandle.Invalidate();
-}
-
 void ATankProjectile::OnSphereComponentHit(UPrimitiveComponent* HitComponent, AActor* OtherActor,
                                            UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
@@ -61,7 +61,12 @@ void ATankProjectile::OnSphereComponentHit(UPrimitiveComponent* HitComponent, AA
 	SpawnHitParticleSystem(Hit.Location);
 
 	if (UKismetSystemLibrary::IsValid(CallbackObject))
+	{
 		IShootingInterface::Execute_ProjectileHit(CallbackObject, this, HitComponent, OtherActor, OtherComp, NormalImpulse, Hit);
+
+		if (auto Shooter = Cast<IShootingInterface>(CallbackObject))
+			Shooter->ShotHit(ShotId, Hit);
+	}
 	
 	// UKismetSystemLibrary::PrintString(GetWorld(), FString::Printf(TEXT("(ATankProjectile::OnSphereComponentHit) Projectile Hit: %s"), *OtherActor->GetName()),
 	// 		true, true, FLinearColor::Red, 15);
@@ -73,33 +78,24 @@ void ATankProjectile::OnSphereComponentHit(UPrimitiveComponent* HitComponent, AA
 
 void ATankProjectile::SpawnHitParticleSystem(const FVector& Location)
 {
-	for (auto Element : HitParticleSystems)
-	{
-		UGameplayStatics::SpawnEmitterAtLocation(GetWorld(),
-		                                         Element.ParticleSystem, Location,
-		                                         FRotator(0), FVector(1), true,
-		                                         EPSCPoolMethod::AutoRelease
-		);
-
-		UNiagaraFunctionLibrary::SpawnSystemAtLocation(GetWorld(), Element.NiagaraSystem, Location, FRotator(0),
-		                                               FVector(1), true, true, ENCPoolMethod::AutoRelease);
-	}
+	// null on dedicated servers
+	auto VFX = GetWorld()->GetSubsystem<UTankVFXSubsystem>();
+	if (!VFX)
+		return;
+
+	for (const FProjectileSettings& Element : HitParticleSystems)
+		VFX->SpawnAtLocation(Element, Location);
 }
 
 void ATankProjectile::SpawnTrails(const FVector& Location)
 {
-	for (auto Element : TrailParticleSystems)
-	{
-		UGameplayStatics::SpawnEmitterAttached(Element.ParticleSystem, GetRootComponent(), "", Location,
-											   FRotator(0), FVector(1), EAttachLocation::Type::SnapToTarget, true,
-											   EPSCPoolMethod::AutoRelease
-		);
-
-		UNiagaraFunctionLibrary::SpawnSystemAttached(Element.NiagaraSystem, GetRootComponent(), "", Location,
-													 FRotator(0),
-													 EAttachLocation::Type::SnapToTarget, true, true,
-													 ENCPoolMethod::AutoRelease);
-	}
+	// null on dedicated servers
+	auto VFX = GetWorld()->GetSubsystem<UTankVFXSubsystem>();
+	if (!VFX)
+		return;
+
+	for (const FProjectileSettings& Element : TrailParticleSystems)
+		VFX->SpawnAttached(Element, GetRootComponent(), Location);
 }
 
 void ATankProjectile::CreateMesh()
@@ -167,16 +163,6 @@ void ATankProjectile::OnConstruction(const FTransform& Transform)
 	SetMeshAssets();
 }
 
-void ATankProjectile::Tick(float DeltaSeconds)
-{
-	Super::Tick(DeltaSeconds);
-
-	if (bIsInUse)
-		DrawDebugSphere(GetWorld(),
-			GetActorLocation(),
-			400, 32, FColor::White, false, 0.0f);
-}
-
 void ATankProjectile::ResetTransform()
 {
 	SetActorTransform(FTransform(FRotator(0), FVector(0, 0, -100000)));
@@ -187,14 +173,14 @@ void ATankProjectile::Activate_Implementation()
 {
 	SetActorEnableCollision(true);
 	SetActorHiddenInGame(false);
-	SetActorTickEnabled(true);
+
+	// shells can be fired from the muzzle, don't let them hit the tank that fired them
+	SphereCollision->ClearMoveIgnoreActors();
+	if (AActor* Shooter = Cast<AActor>(CallbackObject))
+		SphereCollision->IgnoreActorWhenMoving(Shooter, true);
+
 	ProjectileMovementComponent->Activate(true);
 	bIsInUse = true;
-	
-	TimerHandle.Invalidate();
-	FTimerDelegate TimerDel;
-	TimerDel.BindUFunction(this, FName("Deactivate"), false);
-	GetWorld()->GetTimerManager().SetTimer(TimerHandle, TimerDel, TimeToLive, false);
 
 	FVector ForwardDirection = GetActorForwardVector();
 	ProjectileMovementComponent->Velocity = ForwardDirection * ProjectileMovementComponent->InitialSpeed;
@@ -205,9 +191,36 @@ void ATankProjectile::Deactivate_Implementation()
 {
 	SetActorEnableCollision(false);
 	SetActorHiddenInGame(true);
-	SetActorTickEnabled(false);
 	ProjectileMovementComponent->Deactivate();
+
+	// only hand the slot back once, Deactivate is also called on hit, on reset and when AProjectilePool's expiry heap times it out
+	if (bIsInUse && ProjectilePool)
+		ProjectilePool->ReturnToPool(this);
 	bIsInUse = false;
 
 	ProjectileMovementComponent->StopMovementImmediately();
 }
+
+void ATankProjectile::FastForward(const float Time)
+{
+	if (!bIsInUse || Time <= 0)
+		return;
+
+	const FVector Acceleration(0, 0, ProjectileMovementComponent->GetGravityZ());
+	const FVector Delta = ProjectileMovementComponent->Velocity * Time + 0.5 * Acceleration * FMath::Square(Time);
+
+	ProjectileMovementComponent->Velocity += Acceleration * Time;
+	ProjectileMovementComponent->UpdateComponentVelocity();
+
+	// a blocking hit is dispatched to OnSphereComponentHit like any other
+	SphereCollision->MoveComponent(Delta, GetActorQuat(), true);
+}
+
+void ATankProjectile::StopAt(const FVector& Location)
+{
+	if (!bIsInUse)
+		return;
+
+	SpawnHitParticleSystem(Location);
+	ResetTransform();
+}
@@ -0,0 +1,291 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/TankBallisticsSubsystem.h"
+
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/SphereComponent.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "Libraries/TankDebugDraw.h"
+#include "Projectiles/ShootingInterface.h"
+#include "Projectiles/TankProjectile.h"
+#include "Subsystems/TankVFXSubsystem.h"
+
+DECLARE_STATS_GROUP(TEXT("Ballistics"), STATGROUP_Ballistics, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Simulate Shells"), STAT_BallisticsSimulate, STATGROUP_Ballistics);
+DECLARE_CYCLE_STAT(TEXT("Update Visuals"), STAT_BallisticsVisuals, STATGROUP_Ballistics);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shells In Flight"), STAT_BallisticsShells, STATGROUP_Ballistics);
+
+UTankBallisticsSubsystem::UTankBallisticsSubsystem(): bHasInstances(false)
+{
+	// same responses as ATankProjectile::SphereCollision
+	ResponseParams.CollisionResponse.SetAllChannels(ECR_Ignore);
+	ResponseParams.CollisionResponse.SetResponse(ECC_WorldStatic, ECR_Block);
+	ResponseParams.CollisionResponse.SetResponse(ECC_Pawn, ECR_Block);
+}
+
+bool UTankBallisticsSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	// editor preview worlds never fire shells
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UTankBallisticsSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	Shells.Reserve(256);
+}
+
+void UTankBallisticsSubsystem::Deinitialize()
+{
+	Shells.Empty();
+	ShellTypes.Empty();
+
+	if (IsValid(VisualsActor))
+		VisualsActor->Destroy();
+	VisualsActor = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UTankBallisticsSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UTankBallisticsSubsystem, STATGROUP_Ballistics);
+}
+
+int32 UTankBallisticsSubsystem::FindOrAddShellType(const TSubclassOf<ATankProjectile>& ProjectileClass)
+{
+	const int32 ExistingIndex = ShellTypes.IndexOfByPredicate([&ProjectileClass](const FTankShellType& ShellType)
+	{
+		return ShellType.ProjectileClass == ProjectileClass;
+	});
+
+	if (ExistingIndex != INDEX_NONE)
+		return ExistingIndex;
+
+	const ATankProjectile* Defaults = ProjectileClass->GetDefaultObject<ATankProjectile>();
+
+	FTankShellType& ShellType = ShellTypes.AddDefaulted_GetRef();
+	ShellType.ProjectileClass = ProjectileClass;
+	ShellType.Radius = Defaults->GetSphereCollision()->GetUnscaledSphereRadius();
+	ShellType.GravityScale = Defaults->GetProjectileMovementComponent()->ProjectileGravityScale;
+	ShellType.TimeToLive = Defaults->GetTimeToLive();
+
+	if (GetWorld()->GetNetMode() != NM_DedicatedServer)
+		CreateVisuals(ShellType);
+
+	return ShellTypes.Num() - 1;
+}
+
+void UTankBallisticsSubsystem::CreateVisuals(FTankShellType& ShellType)
+{
+	const ATankProjectile* Defaults = ShellType.ProjectileClass->GetDefaultObject<ATankProjectile>();
+
+	if (!Defaults->GetStaticMesh())
+		return;
+
+	if (!IsValid(VisualsActor))
+	{
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.Name = TEXT("BallisticsVisuals");
+		SpawnParameters.NameMode = FActorSpawnParameters::ESpawnActorNameMode::Requested;
+		SpawnParameters.ObjectFlags = RF_Transient;
+
+		VisualsActor = GetWorld()->SpawnActor<AActor>(SpawnParameters);
+		VisualsActor->SetReplicates(false);
+		VisualsActor->SetRootComponent(NewObject<USceneComponent>(VisualsActor, TEXT("Root")));
+		VisualsActor->GetRootComponent()->RegisterComponent();
+	}
+
+	ShellType.Visuals = NewObject<UInstancedStaticMeshComponent>(VisualsActor);
+	ShellType.Visuals->SetStaticMesh(Defaults->GetStaticMesh());
+	ShellType.Visuals->SetMobility(EComponentMobility::Movable);
+	ShellType.Visuals->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	ShellType.Visuals->SetCastShadow(false);
+	ShellType.Visuals->SetupAttachment(VisualsActor->GetRootComponent());
+	ShellType.Visuals->RegisterComponent();
+}
+
+void UTankBallisticsSubsystem::FireShell(const TSubclassOf<ATankProjectile>& ProjectileClass, const FVector& Origin,
+                                         const FVector& Direction, const double Speed, UObject* CallbackObject, const float CatchUpTime,
+                                         const uint16 ShotId)
+{
+	if (!ProjectileClass)
+		return;
+
+	const int32 TypeIndex = FindOrAddShellType(ProjectileClass);
+
+	FTankShell& Shell = Shells.AddDefaulted_GetRef();
+	Shell.Location = Origin;
+	Shell.Velocity = Direction.GetSafeNormal() * Speed;
+	Shell.ExpireTime = GetWorld()->GetTimeSeconds() + ShellTypes[TypeIndex].TimeToLive - CatchUpTime;
+	Shell.CatchUpTime = FMath::Max(CatchUpTime, 0.f);
+	Shell.TypeIndex = TypeIndex;
+	Shell.CallbackObject = CallbackObject;
+	Shell.IgnoredActor = Cast<AActor>(CallbackObject);
+	Shell.ShotId = ShotId;
+}
+
+bool UTankBallisticsSubsystem::StopShell(const UObject* CallbackObject, const uint16 ShotId, const FVector& Location)
+{
+	const int32 Index = Shells.IndexOfByPredicate([CallbackObject, ShotId](const FTankShell& Shell)
+	{
+		return Shell.ShotId == ShotId && Shell.CallbackObject.Get() == CallbackObject;
+	});
+
+	if (Index == INDEX_NONE)
+		return false;
+
+	SpawnHitParticleSystems(ShellTypes[Shells[Index].TypeIndex], Location);
+	Shells.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	return true;
+}
+
+void UTankBallisticsSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	SET_DWORD_STAT(STAT_BallisticsShells, Shells.Num());
+
+	if (Shells.IsEmpty())
+	{
+		// the last shells were removed last tick, clear their instances once
+		if (bHasInstances)
+		{
+			UpdateVisuals();
+			bHasInstances = false;
+		}
+		return;
+	}
+
+	struct FShellHit
+	{
+		FHitResult Hit;
+		int32 TypeIndex;
+		uint16 ShotId;
+		TWeakObjectPtr<UObject> CallbackObject;
+	};
+
+	// callbacks are run after the update, they may fire new shells
+	TArray<FShellHit, TInlineAllocator<16>> Hits;
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_BallisticsSimulate);
+
+		UWorld* World = GetWorld();
+		const double Now = World->GetTimeSeconds();
+		const float GravityZ = World->GetGravityZ();
+
+		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(BallisticsSweep), false);
+
+		for (int32 i = Shells.Num() - 1; i >= 0; --i)
+		{
+			FTankShell& Shell = Shells[i];
+			const FTankShellType& ShellType = ShellTypes[Shell.TypeIndex];
+
+			if (Now >= Shell.ExpireTime)
+			{
+				Shells.RemoveAtSwap(i, 1, EAllowShrinking::No);
+				continue;
+			}
+
+			const float StepTime = DeltaTime + Shell.CatchUpTime;
+			Shell.CatchUpTime = 0;
+
+			const FVector Acceleration(0, 0, GravityZ * ShellType.GravityScale);
+			const FVector NewLocation = Shell.Location + Shell.Velocity * StepTime + 0.5 * Acceleration * FMath::Square(StepTime);
+
+			QueryParams.ClearIgnoredSourceObjects();
+			if (Shell.IgnoredActor.IsValid())
+				QueryParams.AddIgnoredActor(Shell.IgnoredActor.Get());
+
+			FHitResult Hit;
+			if (World->SweepSingleByChannel(Hit, Shell.Location, NewLocation, FQuat::Identity, ECC_WorldDynamic,
+			                                FCollisionShape::MakeSphere(ShellType.Radius), QueryParams, ResponseParams))
+			{
+				Hits.Add({Hit, Shell.TypeIndex, Shell.ShotId, Shell.CallbackObject});
+				Shells.RemoveAtSwap(i, 1, EAllowShrinking::No);
+				continue;
+			}
+
+			Shell.Location = NewLocation;
+			Shell.Velocity += Acceleration * StepTime;
+		}
+	}
+
+	UpdateVisuals();
+	bHasInstances = true;
+
+#if TANK_DEBUG_DRAW
+	if (TankDebugDraw::IsChannelEnabled(ETankDebugDrawChannel::Projectiles))
+		for (const FTankShell& Shell : Shells)
+			TankDebugDraw::Sphere(GetWorld(), ETankDebugDrawChannel::Projectiles, Shell.Location, ShellTypes[Shell.TypeIndex].Radius, 12, FColor::White);
+#endif
+
+	for (const FShellHit& ShellHit : Hits)
+	{
+		SpawnHitParticleSystems(ShellTypes[ShellHit.TypeIndex], ShellHit.Hit.Location);
+
+		if (UObject* CallbackObject = ShellHit.CallbackObject.Get())
+		{
+			IShootingInterface::Execute_ProjectileHit(CallbackObject, nullptr, nullptr, ShellHit.Hit.GetActor(),
+			                                          ShellHit.Hit.GetComponent(), FVector::ZeroVector, ShellHit.Hit);
+
+			if (auto Shooter = Cast<IShootingInterface>(CallbackObject))
+				Shooter->ShotHit(ShellHit.ShotId, ShellHit.Hit);
+		}
+	}
+}
+
+void UTankBallisticsSubsystem::UpdateVisuals()
+{
+	SCOPE_CYCLE_COUNTER(STAT_BallisticsVisuals);
+
+	for (FTankShellType& ShellType : ShellTypes)
+		ShellType.InstanceTransforms.Reset();
+
+	for (const FTankShell& Shell : Shells)
+	{
+		FTankShellType& ShellType = ShellTypes[Shell.TypeIndex];
+		if (ShellType.Visuals)
+			ShellType.InstanceTransforms.Emplace(Shell.Velocity.ToOrientationQuat(), Shell.Location);
+	}
+
+	for (FTankShellType& ShellType : ShellTypes)
+	{
+		if (!ShellType.Visuals)
+			continue;
+
+		const int32 NumInstances = ShellType.Visuals->GetInstanceCount();
+		const int32 NumShells = ShellType.InstanceTransforms.Num();
+
+		if (NumInstances == 0 && NumShells == 0)
+			continue;
+
+		// only add or remove at the end, every instance is rewritten below anyway
+		for (int32 i = NumInstances - 1; i >= NumShells; --i)
+			ShellType.Visuals->RemoveInstance(i);
+
+		if (NumShells > NumInstances)
+			ShellType.Visuals->AddInstances(TArray<FTransform>(ShellType.InstanceTransforms.GetData() + NumInstances, NumShells - NumInstances), false, true);
+
+		if (NumInstances > 0 && NumShells > 0)
+			ShellType.Visuals->BatchUpdateInstancesTransforms(0, TArrayView<const FTransform>(ShellType.InstanceTransforms.GetData(), FMath::Min(NumInstances, NumShells)),
+			                                                  true, true);
+	}
+}
+
+void UTankBallisticsSubsystem::SpawnHitParticleSystems(const FTankShellType& ShellType, const FVector& Location) const
+{
+	// null on dedicated servers
+	auto VFX = GetWorld()->GetSubsystem<UTankVFXSubsystem>();
+	if (!VFX)
+		return;
+
+	const ATankProjectile* Defaults = ShellType.ProjectileClass->GetDefaultObject<ATankProjectile>();
+
+	for (const FProjectileSettings& Element : Defaults->GetHitParticleSystems())
+		VFX->SpawnAtLocation(Element, Location);
+}
@@ -0,0 +1,177 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/TankLagCompensationSubsystem.h"
+
+#include "TankCharacter.h"
+#include "GameFramework/GameStateBase.h"
+
+DECLARE_STATS_GROUP(TEXT("LagCompensation"), STATGROUP_LagCompensation, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Record"), STAT_LagCompensationRecord, STATGROUP_LagCompensation);
+DECLARE_CYCLE_STAT(TEXT("Rewind Trace"), STAT_LagCompensationRewind, STATGROUP_LagCompensation);
+
+UTankLagCompensationSubsystem::UTankLagCompensationSubsystem(): MaxRewindTime(0.5f), BoundsTolerance(25.0f)
+{
+}
+
+TStatId UTankLagCompensationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UTankLagCompensationSubsystem, STATGROUP_LagCompensation);
+}
+
+double UTankLagCompensationSubsystem::GetServerTime() const
+{
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+	return GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+}
+
+void UTankLagCompensationSubsystem::RegisterTank(ATankCharacter* Tank)
+{
+	if (!Tank || Histories.ContainsByPredicate([Tank](const FTankHistory& History) { return History.Tank == Tank; }))
+		return;
+
+	FTankHistory& History = Histories.AddDefaulted_GetRef();
+	History.Tank = Tank;
+	History.LocalBounds = Tank->CalculateComponentsBoundingBoxInLocalSpace(false, false);
+}
+
+void UTankLagCompensationSubsystem::UnregisterTank(const ATankCharacter* Tank)
+{
+	Histories.RemoveAllSwap([Tank](const FTankHistory& History) { return History.Tank == Tank; }, EAllowShrinking::No);
+}
+
+void UTankLagCompensationSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (Histories.IsEmpty() || GetWorld()->GetNetMode() == NM_Client)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_LagCompensationRecord);
+
+	const double Now = GetServerTime();
+
+	for (int32 i = Histories.Num() - 1; i >= 0; --i)
+	{
+		FTankHistory& History = Histories[i];
+		const ATankCharacter* Tank = History.Tank.Get();
+
+		if (!Tank)
+		{
+			Histories.RemoveAtSwap(i, 1, EAllowShrinking::No);
+			continue;
+		}
+
+		History.Head = (History.Head + 1) % FTankHistory::NumFrames;
+		History.Num = FMath::Min(History.Num + 1, FTankHistory::NumFrames);
+
+		FTankHistoryFrame& Frame = History.Frames[History.Head];
+		Frame.Time = Now;
+		Frame.Location = Tank->GetActorLocation();
+		Frame.Rotation = Tank->GetActorQuat();
+	}
+}
+
+bool UTankLagCompensationSubsystem::GetTransformAtTime(const FTankHistory& History, const double Time, FTransform& OutTransform) const
+{
+	if (History.Num == 0)
+		return false;
+
+	// newer than the newest frame, or older than the oldest one, use the closest frame
+	const FTankHistoryFrame& Newest = History.GetFrame(0);
+	const FTankHistoryFrame& Oldest = History.GetFrame(History.Num - 1);
+
+	if (Time >= Newest.Time || History.Num == 1)
+	{
+		OutTransform = FTransform(Newest.Rotation, Newest.Location);
+		return true;
+	}
+
+	if (Time <= Oldest.Time)
+	{
+		OutTransform = FTransform(Oldest.Rotation, Oldest.Location);
+		return true;
+	}
+
+	for (int32 Age = 1; Age < History.Num; ++Age)
+	{
+		const FTankHistoryFrame& Older = History.GetFrame(Age);
+		if (Older.Time > Time)
+			continue;
+
+		const FTankHistoryFrame& Newer = History.GetFrame(Age - 1);
+		const double Alpha = (Time - Older.Time) / FMath::Max(Newer.Time - Older.Time, UE_DOUBLE_SMALL_NUMBER);
+
+		OutTransform = FTransform(FQuat::Slerp(Older.Rotation, Newer.Rotation, Alpha),
+		                          FMath::Lerp(Older.Location, Newer.Location, Alpha));
+		return true;
+	}
+
+	return false;
+}
+
+bool UTankLagCompensationSubsystem::RewindLineTrace(const ATankCharacter* Shooter, const FVector& Start, const FVector& End,
+                                                    double Time, FHitResult& OutHit) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_LagCompensationRewind);
+
+	const double Now = GetServerTime();
+	Time = FMath::Clamp(Time, Now - MaxRewindTime, Now);
+
+	// the world is traced as it is now. tanks are ignored here because they are tested at their old positions below
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(LagCompensation), false, Shooter);
+	for (const FTankHistory& History : Histories)
+		if (const ATankCharacter* Tank = History.Tank.Get())
+			QueryParams.AddIgnoredActor(Tank);
+
+	GetWorld()->LineTraceSingleByChannel(OutHit, Start, End, ECC_Visibility, QueryParams);
+
+	const FVector ClippedEnd = OutHit.bBlockingHit ? OutHit.Location : End;
+	const FVector Extent(BoundsTolerance);
+
+	float ClosestHitTime = 1.0f;
+	const FTankHistory* ClosestHistory = nullptr;
+	FVector ClosestLocation, ClosestNormal;
+	FTransform ClosestTransform;
+
+	for (const FTankHistory& History : Histories)
+	{
+		if (History.Tank == Shooter || !History.Tank.IsValid())
+			continue;
+
+		FTransform Transform;
+		if (!GetTransformAtTime(History, Time, Transform))
+			continue;
+
+		// test in the tank's local space so its bounds stay an axis aligned box
+		const FVector LocalStart = Transform.InverseTransformPosition(Start);
+		const FVector LocalEnd = Transform.InverseTransformPosition(ClippedEnd);
+
+		FVector HitLocation, HitNormal;
+		float HitTime;
+		if (FMath::LineExtentBoxIntersection(History.LocalBounds, LocalStart, LocalEnd, Extent, HitLocation, HitNormal, HitTime)
+			&& HitTime < ClosestHitTime)
+		{
+			ClosestHitTime = HitTime;
+			ClosestHistory = &History;
+			ClosestLocation = HitLocation;
+			ClosestNormal = HitNormal;
+			ClosestTransform = Transform;
+		}
+	}
+
+	if (ClosestHistory)
+	{
+		ATankCharacter* Tank = ClosestHistory->Tank.Get();
+
+		OutHit = FHitResult(Tank, Tank->GetMesh(), ClosestTransform.TransformPosition(ClosestLocation),
+		                    ClosestTransform.TransformVectorNoScale(ClosestNormal));
+		OutHit.bBlockingHit = true;
+		OutHit.TraceStart = Start;
+		OutHit.TraceEnd = End;
+		OutHit.Time = ClosestHitTime;
+		OutHit.Distance = FVector::Distance(Start, OutHit.Location);
+	}
+
+	return OutHit.bBlockingHit;
+}
@@ -0,0 +1,100 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/TankOutlineSubsystem.h"
+
+#include "TankCharacter.h"
+
+DECLARE_STATS_GROUP(TEXT("Outline"), STATGROUP_TankOutline, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Apply"), STAT_TankOutlineApply, STATGROUP_TankOutline);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Stencil Writes"), STAT_TankOutlineStencilWrites, STATGROUP_TankOutline);
+
+UTankOutlineSubsystem::UTankOutlineSubsystem(): bDirty(false)
+{
+}
+
+bool UTankOutlineSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	// nothing is rendered on a dedicated server
+	return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+TStatId UTankOutlineSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UTankOutlineSubsystem, STATGROUP_TankOutline);
+}
+
+void UTankOutlineSubsystem::RegisterTank(ATankCharacter* Tank)
+{
+	if (!Tank || Outlines.ContainsByPredicate([Tank](const FTankOutlineState& State) { return State.Tank == Tank; }))
+		return;
+
+	FTankOutlineState& State = Outlines.AddDefaulted_GetRef();
+	State.Tank = Tank;
+
+	// the constructor already set the mesh up with no outline, so there is nothing to write until a request
+	if (const USkeletalMeshComponent* Mesh = Tank->GetMesh())
+		State.AppliedStencil = Mesh->CustomDepthStencilValue;
+}
+
+void UTankOutlineSubsystem::UnregisterTank(const ATankCharacter* Tank)
+{
+	Outlines.RemoveAllSwap([Tank](const FTankOutlineState& State) { return State.Tank == Tank; }, EAllowShrinking::No);
+}
+
+void UTankOutlineSubsystem::SetOutline(ATankCharacter* Tank, const bool bActivate, const bool bIsFriend)
+{
+	FTankOutlineState* State = Outlines.FindByPredicate([Tank](const FTankOutlineState& Element) { return Element.Tank == Tank; });
+	if (!State)
+	{
+		// outlined before its BeginPlay registered it
+		RegisterTank(Tank);
+		State = Outlines.FindByPredicate([Tank](const FTankOutlineState& Element) { return Element.Tank == Tank; });
+		if (!State)
+			return;
+	}
+
+	bool& bOutline = bIsFriend ? State->bFriend : State->bEnemy;
+	if (bOutline == bActivate)
+		return;
+
+	bOutline = bActivate;
+	bDirty = true;
+}
+
+int32 UTankOutlineSubsystem::GetWantedStencil(const FTankOutlineState& State)
+{
+	if (State.bFriend)
+		return FriendStencilValue;
+
+	return State.bEnemy ? EnemyStencilValue : 0;
+}
+
+void UTankOutlineSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (!bDirty)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_TankOutlineApply);
+
+	bDirty = false;
+
+	for (FTankOutlineState& State : Outlines)
+	{
+		const int32 WantedStencil = GetWantedStencil(State);
+		if (WantedStencil == State.AppliedStencil)
+			continue;
+
+		const ATankCharacter* Tank = State.Tank.Get();
+		USkeletalMeshComponent* Mesh = Tank ? Tank->GetMesh() : nullptr;
+		if (!Mesh)
+			continue;
+
+		// marks the render state dirty, so only when the value changed
+		Mesh->SetCustomDepthStencilValue(WantedStencil);
+		State.AppliedStencil = WantedStencil;
+		INC_DWORD_STAT(STAT_TankOutlineStencilWrites);
+	}
+}
@@ -0,0 +1,198 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/TankSignificanceSubsystem.h"
+
+#include "TankCharacter.h"
+#include "Animation/TankAnimInstance.h"
+#include "Libraries/TankDebugDraw.h"
+
+DECLARE_STATS_GROUP(TEXT("Significance"), STATGROUP_TankSignificance, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Update"), STAT_TankSignificanceUpdate, STATGROUP_TankSignificance);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Full Rate Tanks"), STAT_TankSignificanceFullRate, STATGROUP_TankSignificance);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Throttled Tanks"), STAT_TankSignificanceThrottled, STATGROUP_TankSignificance);
+
+UTankSignificanceSubsystem::UTankSignificanceSubsystem(): UpdateInterval(0.2f), HighScreenSize(0.15f), MediumScreenSize(0.05f),
+                                                          OffscreenTime(0.5f), HighAnimTickRate(1), MediumAnimTickRate(2),
+                                                          LowAnimTickRate(4), OffscreenAnimTickRate(8),
+                                                          StaticAnimMsPerTank(0.15f), AnimBudgetMs(2.0f), MaxAnimTickRate(16),
+                                                          MaxWheelSmokeTanks(6), CosmeticBucketLimit(ETankSignificance::Medium),
+                                                          TimeSinceUpdate(0)
+{
+}
+
+bool UTankSignificanceSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	// nothing is rendered on a dedicated server
+	return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+TStatId UTankSignificanceSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UTankSignificanceSubsystem, STATGROUP_TankSignificance);
+}
+
+void UTankSignificanceSubsystem::RegisterTank(ATankCharacter* Tank)
+{
+	if (!Tank || Tanks.ContainsByPredicate([Tank](const FTankSignificance& Significance) { return Significance.Tank == Tank; }))
+		return;
+
+	Tanks.AddDefaulted_GetRef().Tank = Tank;
+
+	// the tick rate set in ApplySignificance only does anything with update rate optimisations on
+	if (USkeletalMeshComponent* Mesh = Tank->GetMesh())
+	{
+		Mesh->bEnableUpdateRateOptimizations = true;
+		Mesh->EnableExternalTickRateControl(true);
+	}
+
+	// worked out on the next tick
+	TimeSinceUpdate = UpdateInterval;
+}
+
+void UTankSignificanceSubsystem::UnregisterTank(const ATankCharacter* Tank)
+{
+	Tanks.RemoveAllSwap([Tank](const FTankSignificance& Significance) { return Significance.Tank == Tank; }, EAllowShrinking::No);
+}
+
+ETankSignificance UTankSignificanceSubsystem::GetSignificance(const ATankCharacter* Tank) const
+{
+	const FTankSignificance* Significance = Tanks.FindByPredicate([Tank](const FTankSignificance& Element) { return Element.Tank == Tank; });
+	return Significance ? Significance->Bucket : ETankSignificance::High;
+}
+
+uint8 UTankSignificanceSubsystem::GetBucketAnimTickRate(const ETankSignificance Bucket) const
+{
+	switch (Bucket)
+	{
+	case ETankSignificance::Local:		return 1;
+	case ETankSignificance::High:		return HighAnimTickRate;
+	case ETankSignificance::Medium:		return MediumAnimTickRate;
+	case ETankSignificance::Low:		return LowAnimTickRate;
+	case ETankSignificance::Offscreen:	return OffscreenAnimTickRate;
+	default:							return 1;
+	}
+}
+
+void UTankSignificanceSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	TimeSinceUpdate += DeltaTime;
+	if (Tanks.IsEmpty() || TimeSinceUpdate < UpdateInterval)
+		return;
+
+	TimeSinceUpdate = 0;
+
+	// every local player's view, a tank is as significant as it is in the view it is biggest in
+	struct FView
+	{
+		FVector Location;
+		float TanHalfFOV;
+	};
+	TArray<FView, TInlineAllocator<4>> Views;
+
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (!PlayerController || !PlayerController->IsLocalController() || !PlayerController->PlayerCameraManager)
+			continue;
+
+		const APlayerCameraManager* CameraManager = PlayerController->PlayerCameraManager;
+		Views.Add({CameraManager->GetCameraLocation(), FMath::Tan(FMath::DegreesToRadians(CameraManager->GetFOVAngle() * 0.5f))});
+	}
+
+	if (Views.IsEmpty())
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_TankSignificanceUpdate);
+
+	Tanks.RemoveAllSwap([](const FTankSignificance& Significance) { return !Significance.Tank.IsValid(); }, EAllowShrinking::No);
+
+	for (FTankSignificance& Significance : Tanks)
+	{
+		const ATankCharacter* Tank = Significance.Tank.Get();
+		const USkeletalMeshComponent* Mesh = Tank->GetMesh();
+
+		if (Tank->IsLocallyControlled())
+		{
+			Significance.Score = MAX_flt;
+			Significance.Bucket = ETankSignificance::Local;
+			continue;
+		}
+
+		// rough fraction of the screen height the tank's bounds cover
+		Significance.Score = 0;
+		for (const FView& View : Views)
+		{
+			const float Distance = FMath::Max(FVector::Dist(View.Location, Mesh->Bounds.Origin), 1.0f);
+			Significance.Score = FMath::Max(Significance.Score, static_cast<float>(Mesh->Bounds.SphereRadius / (Distance * View.TanHalfFOV)));
+		}
+
+		if (!Mesh->WasRecentlyRendered(OffscreenTime))
+			Significance.Bucket = ETankSignificance::Offscreen;
+		else if (Significance.Score >= HighScreenSize)
+			Significance.Bucket = ETankSignificance::High;
+		else if (Significance.Score >= MediumScreenSize)
+			Significance.Bucket = ETankSignificance::Medium;
+		else
+			Significance.Bucket = ETankSignificance::Low;
+	}
+
+	// most significant first, so they get the budget before anyone else
+	Tanks.Sort([](const FTankSignificance& A, const FTankSignificance& B)
+	{
+		if ((A.Bucket == ETankSignificance::Offscreen) != (B.Bucket == ETankSignificance::Offscreen))
+			return B.Bucket == ETankSignificance::Offscreen;
+
+		return A.Score > B.Score;
+	});
+
+	float SpentMs = 0;
+	int32 NumFullRate = 0;
+	int32 NumWheelSmoke = 0;
+
+	for (FTankSignificance& Significance : Tanks)
+	{
+		uint8 TickRate = GetBucketAnimTickRate(Significance.Bucket);
+
+		// over budget, so halve how often this tank animates until it fits. the local tank is never slowed down
+		if (Significance.Bucket != ETankSignificance::Local)
+			while (SpentMs + StaticAnimMsPerTank / TickRate > AnimBudgetMs && TickRate < MaxAnimTickRate)
+				TickRate = FMath::Min<uint8>(TickRate * 2, MaxAnimTickRate);
+
+		SpentMs += StaticAnimMsPerTank / TickRate;
+		NumFullRate += TickRate == 1;
+
+		Significance.AnimTickRate = TickRate;
+
+		// the list is sorted, so the smoke goes to the most significant tanks
+		Significance.bWheelSmoke = Significance.Bucket != ETankSignificance::Offscreen && NumWheelSmoke < MaxWheelSmokeTanks;
+		NumWheelSmoke += Significance.bWheelSmoke;
+		Significance.bCosmetics = Significance.Bucket <= CosmeticBucketLimit;
+
+		ApplySignificance(Significance);
+	}
+
+	SET_DWORD_STAT(STAT_TankSignificanceFullRate, NumFullRate);
+	SET_DWORD_STAT(STAT_TankSignificanceThrottled, Tanks.Num() - NumFullRate);
+}
+
+void UTankSignificanceSubsystem::ApplySignificance(const FTankSignificance& Significance) const
+{
+	ATankCharacter* Tank = Significance.Tank.Get();
+	USkeletalMeshComponent* Mesh = Tank->GetMesh();
+
+	Mesh->SetExternalTickRate(Significance.AnimTickRate);
+
+	if (UTankAnimInstance* AnimInstance = Tank->GetAnimInstance())
+		AnimInstance->bUpdateWheelsAndTracks = Significance.Bucket != ETankSignificance::Offscreen;
+
+	Tank->SetCosmeticsEnabled(Significance.bWheelSmoke, Significance.bCosmetics);
+
+	TankDebugDraw::String(GetWorld(), ETankDebugDrawChannel::Significance, Mesh->Bounds.Origin + FVector(0, 0, Mesh->Bounds.BoxExtent.Z + 100),
+		FString::Printf(TEXT("%s  1/%d  %.3f%s%s"), *UEnum::GetDisplayValueAsText(Significance.Bucket).ToString(), Significance.AnimTickRate,
+			Significance.Score, Significance.bWheelSmoke ? TEXT("  smoke") : TEXT(""), Significance.bCosmetics ? TEXT("  cosmetics") : TEXT("")),
+		Significance.Bucket == ETankSignificance::Offscreen ? FColor::Red : FColor::Green,
+		UpdateInterval);
+}
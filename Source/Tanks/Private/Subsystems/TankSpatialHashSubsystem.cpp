@@ -0,0 +1,246 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/TankSpatialHashSubsystem.h"
+
+#include "TankCharacter.h"
+#include "Components/TankHealthComponent.h"
+#include "GameFramework/TankPlayerState.h"
+
+DECLARE_STATS_GROUP(TEXT("SpatialHash"), STATGROUP_TankSpatialHash, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Rebuild"), STAT_TankSpatialHashRebuild, STATGROUP_TankSpatialHash);
+DECLARE_CYCLE_STAT(TEXT("Query"), STAT_TankSpatialHashQuery, STATGROUP_TankSpatialHash);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tanks"), STAT_TankSpatialHashTanks, STATGROUP_TankSpatialHash);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Cells"), STAT_TankSpatialHashCells, STATGROUP_TankSpatialHash);
+
+UTankSpatialHashSubsystem::UTankSpatialHashSubsystem(): CellSize(5000.0f), MaxRadius(0)
+{
+}
+
+TStatId UTankSpatialHashSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UTankSpatialHashSubsystem, STATGROUP_TankSpatialHash);
+}
+
+void UTankSpatialHashSubsystem::RegisterTank(ATankCharacter* Tank)
+{
+	if (!Tank || RegisteredTanks.Contains(Tank))
+		return;
+
+	RegisteredTanks.Add(Tank);
+}
+
+void UTankSpatialHashSubsystem::UnregisterTank(const ATankCharacter* Tank)
+{
+	RegisteredTanks.RemoveAllSwap([Tank](const TWeakObjectPtr<ATankCharacter>& Element) { return Element == Tank; }, EAllowShrinking::No);
+
+	// the grid keeps its slot until the next rebuild, queries skip it
+	const int32 Index = Tanks.IndexOfByKey(Tank);
+	if (Index != INDEX_NONE)
+		Tanks[Index] = nullptr;
+}
+
+FIntPoint UTankSpatialHashSubsystem::GetCell(const float X, const float Y) const
+{
+	return FIntPoint(FMath::FloorToInt32(X / CellSize), FMath::FloorToInt32(Y / CellSize));
+}
+
+void UTankSpatialHashSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	Rebuild();
+
+	SET_DWORD_STAT(STAT_TankSpatialHashTanks, Tanks.Num());
+	SET_DWORD_STAT(STAT_TankSpatialHashCells, Cells.Num());
+}
+
+void UTankSpatialHashSubsystem::Rebuild()
+{
+	SCOPE_CYCLE_COUNTER(STAT_TankSpatialHashRebuild);
+
+	Tanks.Reset();
+	PositionsX.Reset();
+	PositionsY.Reset();
+	PositionsZ.Reset();
+	Radii.Reset();
+	Teams.Reset();
+	TankCells.Reset();
+	MaxRadius = 0;
+
+	for (int32 i = RegisteredTanks.Num() - 1; i >= 0; --i)
+	{
+		ATankCharacter* Tank = RegisteredTanks[i].Get();
+		if (!Tank || !Tank->GetMesh())
+		{
+			if (!Tank)
+				RegisteredTanks.RemoveAtSwap(i, 1, EAllowShrinking::No);
+			continue;
+		}
+
+		// dead tanks are kept for respawning. their wreck is not a tank, the physics queries never found it either
+		UTankHealthComponent* HealthComponent = Tank->GetHealthComponent();
+		if ((HealthComponent && HealthComponent->IsDead()) || Tank->GetMesh()->bHiddenInGame || !Tank->GetMesh()->IsCollisionEnabled())
+			continue;
+
+		const FBoxSphereBounds& Bounds = Tank->GetMesh()->Bounds;
+		const ATankPlayerState* TankPlayerState = Tank->GetPlayerState<ATankPlayerState>();
+
+		Tanks.Add(Tank);
+		PositionsX.Add(Bounds.Origin.X);
+		PositionsY.Add(Bounds.Origin.Y);
+		PositionsZ.Add(Bounds.Origin.Z);
+		Radii.Add(Bounds.SphereRadius);
+		Teams.Add(TankPlayerState ? TankPlayerState->GetCurrentTeam() : ETeam::Unassigned);
+		TankCells.Add(GetCell(Bounds.Origin.X, Bounds.Origin.Y));
+
+		MaxRadius = FMath::Max(MaxRadius, static_cast<float>(Bounds.SphereRadius));
+	}
+
+	// batch kernels read four positions at a time, the padding is too far away to ever be in range
+	while (PositionsX.Num() % 4 != 0)
+	{
+		PositionsX.Add(UE_BIG_NUMBER);
+		PositionsY.Add(UE_BIG_NUMBER);
+		PositionsZ.Add(UE_BIG_NUMBER);
+	}
+
+	// sorted by cell, so each cell is one run of indices
+	CellIndices.Reset();
+	for (int32 i = 0; i < Tanks.Num(); ++i)
+		CellIndices.Add(i);
+
+	CellIndices.Sort([this](const int32 A, const int32 B)
+	{
+		return TankCells[A].X != TankCells[B].X ? TankCells[A].X < TankCells[B].X : TankCells[A].Y < TankCells[B].Y;
+	});
+
+	Cells.Reset();
+	for (int32 i = 0; i < CellIndices.Num(); ++i)
+	{
+		FTankHashCell& Cell = Cells.FindOrAdd(TankCells[CellIndices[i]], {i, 0});
+		++Cell.Num;
+	}
+}
+
+template <typename FunctionType>
+void UTankSpatialHashSubsystem::ForEachCandidate(const FVector& Min, const FVector& Max, const AActor* IgnoreActor, FunctionType&& Function) const
+{
+	const FIntPoint MinCell = GetCell(Min.X - MaxRadius, Min.Y - MaxRadius);
+	const FIntPoint MaxCell = GetCell(Max.X + MaxRadius, Max.Y + MaxRadius);
+
+	// a query covering more cells than are occupied is faster as a straight pass over all tanks
+	const int64 NumCellsInRange = static_cast<int64>(MaxCell.X - MinCell.X + 1) * (MaxCell.Y - MinCell.Y + 1);
+	if (NumCellsInRange >= Cells.Num())
+	{
+		for (int32 i = 0; i < Tanks.Num(); ++i)
+			if (Tanks[i] && Tanks[i] != IgnoreActor)
+				Function(i);
+		return;
+	}
+
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			const FTankHashCell* Cell = Cells.Find(FIntPoint(X, Y));
+			if (!Cell)
+				continue;
+
+			for (int32 k = Cell->Start; k < Cell->Start + Cell->Num; ++k)
+			{
+				const int32 Index = CellIndices[k];
+				if (Tanks[Index] && Tanks[Index] != IgnoreActor)
+					Function(Index);
+			}
+		}
+	}
+}
+
+void UTankSpatialHashSubsystem::QueryRadius(const FVector& Center, const float Radius, TArray<ATankCharacter*>& OutTanks,
+                                            const AActor* IgnoreActor) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_TankSpatialHashQuery);
+
+	ForEachCandidate(Center - Radius, Center + Radius, IgnoreActor, [&](const int32 Index)
+	{
+		if (FVector::DistSquared(GetPosition(Index), Center) <= FMath::Square(Radius + Radii[Index]))
+			OutTanks.Add(Tanks[Index]);
+	});
+}
+
+void UTankSpatialHashSubsystem::QueryCone(const FVector& Origin, const FVector& Direction, const float Length, const float StartRadius,
+                                          const float EndRadius, TArray<ATankCharacter*>& OutTanks, const AActor* IgnoreActor) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_TankSpatialHashQuery);
+
+	if (Length <= 0)
+		return;
+
+	const FVector End = Origin + Direction * Length;
+	const float ConeMaxRadius = FMath::Max(StartRadius, EndRadius);
+
+	ForEachCandidate(Origin.ComponentMin(End) - ConeMaxRadius, Origin.ComponentMax(End) + ConeMaxRadius, IgnoreActor, [&](const int32 Index)
+	{
+		const FVector Position = GetPosition(Index);
+		const float Radius = Radii[Index];
+		const float CenterDistance = FVector::DotProduct(Position - Origin, Direction);
+
+		// fully behind the tip or past the end
+		if (CenterDistance + Radius < 0 || CenterDistance - Radius > Length)
+			return;
+
+		// the cone's radius at the closest point on the axis
+		const float AxisDistance = FMath::Clamp(CenterDistance, 0.0f, Length);
+		const float ConeRadius = FMath::Lerp(StartRadius, EndRadius, AxisDistance / Length);
+
+		if (FVector::DistSquared(Position, Origin + Direction * AxisDistance) <= FMath::Square(ConeRadius + Radius))
+			OutTanks.Add(Tanks[Index]);
+	});
+}
+
+void UTankSpatialHashSubsystem::QueryBox(const FVector& Center, const FVector& HalfExtent, const FQuat& Rotation,
+                                         TArray<ATankCharacter*>& OutTanks, const AActor* IgnoreActor) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_TankSpatialHashQuery);
+
+	const FBox WorldBounds = FBox(-HalfExtent, HalfExtent).TransformBy(FTransform(Rotation, Center));
+
+	ForEachCandidate(WorldBounds.Min, WorldBounds.Max, IgnoreActor, [&](const int32 Index)
+	{
+		// closest point of the box to the tank, in the box's space
+		const FVector LocalPosition = Rotation.UnrotateVector(GetPosition(Index) - Center);
+		const FVector Closest = LocalPosition.BoundToBox(-HalfExtent, HalfExtent);
+
+		if (FVector::DistSquared(LocalPosition, Closest) <= FMath::Square(Radii[Index]))
+			OutTanks.Add(Tanks[Index]);
+	});
+}
+
+void UTankSpatialHashSubsystem::QueryTeamInRange(const ETeam Team, const FVector& Center, const float Radius, TArray<ATankCharacter*>& OutInRange,
+                                                 const AActor* IgnoreActor) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_TankSpatialHashQuery);
+
+	const VectorRegister4Float CenterX = VectorSetFloat1(Center.X);
+	const VectorRegister4Float CenterY = VectorSetFloat1(Center.Y);
+	const VectorRegister4Float CenterZ = VectorSetFloat1(Center.Z);
+	const VectorRegister4Float RadiusSquared = VectorSetFloat1(FMath::Square(Radius));
+
+	// four tanks per iteration, squared so there is no sqrt. the padding is never in range
+	for (int32 i = 0; i < PositionsX.Num(); i += 4)
+	{
+		const VectorRegister4Float DeltaX = VectorSubtract(VectorLoad(&PositionsX[i]), CenterX);
+		const VectorRegister4Float DeltaY = VectorSubtract(VectorLoad(&PositionsY[i]), CenterY);
+		const VectorRegister4Float DeltaZ = VectorSubtract(VectorLoad(&PositionsZ[i]), CenterZ);
+		const VectorRegister4Float DistanceSquared = VectorMultiplyAdd(DeltaZ, DeltaZ, VectorMultiplyAdd(DeltaY, DeltaY, VectorMultiply(DeltaX, DeltaX)));
+
+		// only the few tanks in range are looked at one by one
+		for (uint32 Mask = VectorMaskBits(VectorCompareLE(DistanceSquared, RadiusSquared)); Mask != 0; Mask &= Mask - 1)
+		{
+			const int32 Index = i + FMath::CountTrailingZeros(Mask);
+			if (Teams[Index] == Team && Tanks[Index] && Tanks[Index] != IgnoreActor)
+				OutInRange.Add(Tanks[Index]);
+		}
+	}
+}
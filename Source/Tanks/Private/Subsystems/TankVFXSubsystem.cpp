@@ -0,0 +1,155 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/TankVFXSubsystem.h"
+
+#include "NiagaraComponent.h"
+#include "NiagaraSystem.h"
+#include "Kismet/GameplayStatics.h"
+#include "Projectiles/TankProjectile.h"
+
+DECLARE_STATS_GROUP(TEXT("TankVFX"), STATGROUP_TankVFX, STATCAT_Advanced);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled Niagara Components"), STAT_TankVFXComponents, STATGROUP_TankVFX);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pool Misses"), STAT_TankVFXMisses, STATGROUP_TankVFX);
+
+UTankVFXSubsystem::UTankVFXSubsystem(): DefaultPoolSize(4)
+{
+}
+
+bool UTankVFXSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	// nothing is rendered on a dedicated server
+	return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UTankVFXSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	for (const FTankVFXPoolSize& PooledSystem : PooledSystems)
+		if (UNiagaraSystem* System = PooledSystem.System.LoadSynchronous())
+			FindOrCreatePool(System, PooledSystem.PoolSize);
+}
+
+void UTankVFXSubsystem::Deinitialize()
+{
+	for (auto& Pool : Pools)
+		for (UNiagaraComponent* Component : Pool.Value.FreeComponents)
+			if (IsValid(Component))
+				Component->DestroyComponent();
+
+	Pools.Empty();
+
+	Super::Deinitialize();
+}
+
+FTankNiagaraPool& UTankVFXSubsystem::FindOrCreatePool(UNiagaraSystem* System, const int32 PoolSize)
+{
+	if (FTankNiagaraPool* Pool = Pools.Find(System))
+		return *Pool;
+
+	FTankNiagaraPool& Pool = Pools.Add(System);
+	Pool.PoolSize = PoolSize;
+	Pool.FreeComponents.Reserve(PoolSize);
+
+	for (int32 i = 0; i < PoolSize; ++i)
+		Pool.FreeComponents.Add(CreatePooledComponent(System));
+
+	return Pool;
+}
+
+UNiagaraComponent* UTankVFXSubsystem::CreatePooledComponent(UNiagaraSystem* System)
+{
+	UWorld* World = GetWorld();
+
+	UNiagaraComponent* Component = NewObject<UNiagaraComponent>(World);
+	Component->SetAutoActivate(false);
+	Component->SetAutoDestroy(false);
+	Component->SetAsset(System);
+	Component->OnSystemFinished.AddDynamic(this, &UTankVFXSubsystem::OnPooledSystemFinished);
+	Component->RegisterComponentWithWorld(World);
+
+	INC_DWORD_STAT(STAT_TankVFXComponents);
+
+	return Component;
+}
+
+UNiagaraComponent* UTankVFXSubsystem::AcquireComponent(UNiagaraSystem* System)
+{
+	if (!System)
+		return nullptr;
+
+	FTankNiagaraPool& Pool = FindOrCreatePool(System, DefaultPoolSize);
+
+	if (!Pool.FreeComponents.IsEmpty())
+		return Pool.FreeComponents.Pop(EAllowShrinking::No);
+
+	++Pool.Misses;
+	INC_DWORD_STAT(STAT_TankVFXMisses);
+	return CreatePooledComponent(System);
+}
+
+void UTankVFXSubsystem::OnPooledSystemFinished(UNiagaraComponent* Component)
+{
+	if (!IsValid(Component))
+		return;
+
+	if (Component->GetAttachParent())
+		Component->DetachFromComponent(FDetachmentTransformRules::KeepWorldTransform);
+
+	FTankNiagaraPool* Pool = Pools.Find(Component->GetAsset());
+	if (Pool && Pool->FreeComponents.Num() < Pool->PoolSize)
+	{
+		Pool->FreeComponents.Push(Component);
+		return;
+	}
+
+	// created for a miss, the pool is back to its pre-warm size without it
+	Component->DestroyComponent();
+	DEC_DWORD_STAT(STAT_TankVFXComponents);
+}
+
+UNiagaraComponent* UTankVFXSubsystem::SpawnNiagaraAtLocation(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation)
+{
+	UNiagaraComponent* Component = AcquireComponent(System);
+	if (!Component)
+		return nullptr;
+
+	Component->SetWorldLocationAndRotation(Location, Rotation);
+	Component->Activate(true);
+	return Component;
+}
+
+UNiagaraComponent* UTankVFXSubsystem::SpawnNiagaraAttached(UNiagaraSystem* System, USceneComponent* AttachToComponent, const FVector& Location)
+{
+	if (!AttachToComponent)
+		return nullptr;
+
+	UNiagaraComponent* Component = AcquireComponent(System);
+	if (!Component)
+		return nullptr;
+
+	Component->AttachToComponent(AttachToComponent, FAttachmentTransformRules::SnapToTargetNotIncludingScale);
+	Component->SetRelativeLocation(Location);
+	Component->Activate(true);
+	return Component;
+}
+
+void UTankVFXSubsystem::SpawnAtLocation(const FProjectileSettings& Settings, const FVector& Location, const FRotator& Rotation)
+{
+	if (Settings.bUseNiagaraSystem)
+		SpawnNiagaraAtLocation(Settings.NiagaraSystem, Location, Rotation);
+	else if (Settings.ParticleSystem)
+		UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), Settings.ParticleSystem, Location, Rotation,
+		                                         FVector(1), true, EPSCPoolMethod::AutoRelease);
+}
+
+void UTankVFXSubsystem::SpawnAttached(const FProjectileSettings& Settings, USceneComponent* AttachToComponent, const FVector& Location)
+{
+	if (Settings.bUseNiagaraSystem)
+		SpawnNiagaraAttached(Settings.NiagaraSystem, AttachToComponent, Location);
+	else if (Settings.ParticleSystem)
+		UGameplayStatics::SpawnEmitterAttached(Settings.ParticleSystem, AttachToComponent, NAME_None, Location,
+		                                       FRotator(0), FVector(1), EAttachLocation::Type::SnapToTarget, true,
+		                                       EPSCPoolMethod::AutoRelease);
+}
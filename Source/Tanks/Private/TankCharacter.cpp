@@ -7,7 +7,6 @@
 #include "ChaosWheeledVehicleMovementComponent.h"
 #include "EnhancedCodeFlow.h"
 #include "EnhancedInputComponent.h"
-#include "NiagaraFunctionLibrary.h"
 #include "TankController.h"
 #include "Blueprint/WidgetLayoutLibrary.h"
 #include "Camera/CameraComponent.h"
@@ -23,16 +22,55 @@
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "Libraries/TankDebugDraw.h"
+#include "Libraries/TFL.h"
 #include "Net/UnrealNetwork.h"
 #include "PhysicsEngine/RadialForceComponent.h"
 #include "Projectiles/ProjectilePool.h"
 #include "Projectiles/TankDamageType.h"
 #include "Projectiles/TankProjectile.h"
+#include "Subsystems/TankLagCompensationSubsystem.h"
+#include "Subsystems/TankOutlineSubsystem.h"
+#include "Subsystems/TankSignificanceSubsystem.h"
+#include "Subsystems/TankSpatialHashSubsystem.h"
+#include "Subsystems/TankVFXSubsystem.h"
 #include "Tanks/Public/Animation/TankAnimInstance.h"
 #include "UI/WB_GunSight.h"
 
-static int FriendStencilValue = 2;
-static int EnemyStencilValue = 1;
+// how far the turret trace goes
+static constexpr double ShootTraceDistance = 15200.0;
+
+// the client's shoot timer can finish a little early and shots can arrive bunched up by the network
+static constexpr double ServerShotCooldownTolerance = 0.2;
+
+DECLARE_CYCLE_STAT(TEXT("Camera Trace"), STAT_TankTick_CameraTrace, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Turret Trace"), STAT_TankTick_TurretTrace, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Turret Turning"), STAT_TankTick_TurretTurning, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Gun Elevation"), STAT_TankTick_GunElevation, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Barrel Clearance"), STAT_TankTick_BarrelClearance, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Camera Pitch Limits"), STAT_TankTick_CameraPitchLimits, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Cone Trace"), STAT_TankTick_ConeTrace, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Aim Assist"), STAT_TankTick_AimAssist, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Gun Sight"), STAT_TankTick_GunSight, STATGROUP_TankTick);
+DECLARE_CYCLE_STAT(TEXT("Highlighting"), STAT_TankTick_Highlighting, STATGROUP_TankTick);
+
+static TStatId GetTickTaskStatId(const ETankTickTask Task)
+{
+	switch (Task)
+	{
+	case ETankTickTask::CameraTrace:		return GET_STATID(STAT_TankTick_CameraTrace);
+	case ETankTickTask::TurretTrace:		return GET_STATID(STAT_TankTick_TurretTrace);
+	case ETankTickTask::TurretTurning:		return GET_STATID(STAT_TankTick_TurretTurning);
+	case ETankTickTask::GunElevation:		return GET_STATID(STAT_TankTick_GunElevation);
+	case ETankTickTask::BarrelClearance:	return GET_STATID(STAT_TankTick_BarrelClearance);
+	case ETankTickTask::CameraPitchLimits:	return GET_STATID(STAT_TankTick_CameraPitchLimits);
+	case ETankTickTask::ConeTrace:			return GET_STATID(STAT_TankTick_ConeTrace);
+	case ETankTickTask::AimAssist:			return GET_STATID(STAT_TankTick_AimAssist);
+	case ETankTickTask::GunSight:			return GET_STATID(STAT_TankTick_GunSight);
+	case ETankTickTask::Highlighting:		return GET_STATID(STAT_TankTick_Highlighting);
+	default:								return TStatId();
+	}
+}
 
 ATankCharacter::ATankCharacter(): TankHighlightingComponent(CreateDefaultSubobject<UTankHighlightingComponent>("TankHighlightingComponent")),
 								  TankPowerUpManagerComponent(CreateDefaultSubobject<UTankPowerUpManagerComponent>("TankPowerUpManagerComponent")),
@@ -40,10 +78,15 @@ ATankCharacter::ATankCharacter(): TankHighlightingComponent(CreateDefaultSubobje
 								  TankTargetingSystem(CreateDefaultSubobject<UTankTargetingSystem>("TankTargetingSystem")),
 								  RadialForceComponent(CreateDefaultSubobject<URadialForceComponent>("RadialForceComponent")),
 								  DamagedStaticMesh(CreateDefaultSubobject<UStaticMeshComponent>("Damaged Tank Mesh")),
+								  ConeTraceLength(0),
 								  MaxZoomIn(500), MaxZoomOut(2500), BasePitchMin(-20.0), BasePitchMax(10.0),
                                   AbsoluteMinGunElevation(-5), AbsoluteMaxGunElevation(30), TurretRotationSpeed(200),
                                   AimingTurretRotationSpeed(90), GunElevationInterpSpeed(10), BaseDamage(500),
+                                  BallisticsMode(ETankBallisticsMode::Auto), HitscanTimeThreshold(0.15), MaxMuzzleError(500), ShellSpeed(50000),
+                                  AimStateResendInterval(0.5), AimStateInterpSpeed(15), AimPointReplicationThreshold(50),
                                   MinGunElevation(-15), MaxGunElevation(20), GunElevation(0), CurrentTurretAngle(0),
+                                  LastAimStateSendTime(0), bWheelSmokeEnabled(true), bCosmeticsEnabled(true), CurrentLightsEmissivity(0), NextShotId(0),
+                                  LastServerShotTime(TNumericLimits<double>::Lowest()),
                                   bIsInAir(false), 
                                   DesiredGunElevation(0), 
                                   LookValues(), MoveValues(), bAimingIn(false)
@@ -119,9 +162,10 @@ void ATankCharacter::GetLifetimeReplicatedProps(TArray<class FLifetimeProperty>&
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME(ThisClass, CurrentTurretAngle);
+	DOREPLIFETIME_CONDITION(ThisClass, AimState, COND_SkipOwner);
 	DOREPLIFETIME(ThisClass, CurrentTeam);
 	DOREPLIFETIME(ThisClass, PlayerName);
+	DOREPLIFETIME_CONDITION(ThisClass, AuthoritativeAimPoint, COND_OwnerOnly);
 }
 
 void ATankCharacter::PossessedBy(AController* NewController)
@@ -134,6 +178,83 @@ void ATankCharacter::PossessedBy(AController* NewController)
 	DamagedStaticMesh->SetVisibility(false);
 }
 
+void ATankCharacter::NotifyControllerChanged()
+{
+	Super::NotifyControllerChanged();
+
+	// IsLocallyControlled can only change with the controller
+	ResolveTickTiers();
+}
+
+void ATankCharacter::ResolveTickTiers()
+{
+	const FTankTickTiers& Tiers = GetDefault<UTankTickSettings>()->GetTiers(IsLocallyControlled());
+
+	for (int32 i = 0; i < TickTasks.Num(); ++i)
+	{
+		FTankTickTaskState& TaskState = TickTasks[i];
+		TaskState.Tier = Tiers.GetTier(static_cast<ETankTickTask>(i));
+
+		// start every tank at a random phase so the reduced rate tasks of all tanks do not land on the same frame
+		TaskState.Time = FMath::FRand() * UTankTickSettings::GetTierInterval(TaskState.Tier);
+	}
+}
+
+bool ATankCharacter::ShouldRunTickTask(const ETankTickTask Task, const float DeltaTime, float& OutDeltaTime)
+{
+	FTankTickTaskState& TaskState = TickTasks[static_cast<int32>(Task)];
+	TaskState.Time += DeltaTime;
+
+	if (!TaskState.bRequested)
+	{
+		if (TaskState.Tier == ETankTickTier::OnEvent)
+			return false;
+
+		if (TaskState.Time < UTankTickSettings::GetTierInterval(TaskState.Tier))
+			return false;
+	}
+
+	// no catching up, a late task just runs once with the whole time it missed
+	OutDeltaTime = TaskState.Time;
+	TaskState.Time = 0;
+	TaskState.bRequested = false;
+	return true;
+}
+
+bool ATankCharacter::ShouldRunAsyncTickTask(const ETankTickTask Task, const float DeltaTime, float& OutDeltaTime, bool& bOutRequestTraces)
+{
+	FTankTickTaskState& TaskState = TickTasks[static_cast<int32>(Task)];
+	TaskState.Time += DeltaTime;
+
+	// results are only kept for the tick after the request, so traces from before a skipped tick, e.g. while
+	// locked on, are gone and have to be requested again
+	const bool bTracesReady = TaskState.bPrefetched && TaskState.PrefetchFrame + 1 == GFrameCounter;
+
+	if (bTracesReady)
+	{
+		// run now even if the frame was shorter than expected. every frame, this run requests the next one's traces.
+		OutDeltaTime = TaskState.Time;
+		TaskState.Time = 0;
+		TaskState.bRequested = false;
+		bOutRequestTraces = TaskState.Tier == ETankTickTier::EveryFrame;
+	}
+	else
+	{
+		// due on the next tick if it is as long as this one. a late task loses a frame instead of running without results.
+		bOutRequestTraces = TaskState.bRequested
+			|| (TaskState.Tier != ETankTickTier::OnEvent && TaskState.Time + DeltaTime >= UTankTickSettings::GetTierInterval(TaskState.Tier));
+	}
+
+	TaskState.bPrefetched = bOutRequestTraces;
+	TaskState.PrefetchFrame = GFrameCounter;
+	return bTracesReady;
+}
+
+void ATankCharacter::RequestTickTask(const ETankTickTask Task)
+{
+	TickTasks[static_cast<int32>(Task)].bRequested = true;
+}
+
 void ATankCharacter::BeginPlay()
 {
 	Super::BeginPlay();
@@ -151,6 +272,20 @@ void ATankCharacter::BeginPlay()
 	ResetCameraRotation();
 	SetDefaults();
 	BindDelegates();
+	ResolveTickTiers();
+
+	if (HasAuthority())
+		if (auto LagCompensation = GetWorld()->GetSubsystem<UTankLagCompensationSubsystem>())
+			LagCompensation->RegisterTank(this);
+
+	if (auto Significance = GetWorld()->GetSubsystem<UTankSignificanceSubsystem>())
+		Significance->RegisterTank(this);
+
+	if (auto SpatialHash = GetWorld()->GetSubsystem<UTankSpatialHashSubsystem>())
+		SpatialHash->RegisterTank(this);
+
+	if (auto Outlines = GetWorld()->GetSubsystem<UTankOutlineSubsystem>())
+		Outlines->RegisterTank(this);
 
 	DamagedStaticMesh->SetHiddenInGame(true);
 	DamagedStaticMesh->SetVisibility(false);
@@ -160,6 +295,18 @@ void ATankCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
 
+	if (auto LagCompensation = GetWorld()->GetSubsystem<UTankLagCompensationSubsystem>())
+		LagCompensation->UnregisterTank(this);
+
+	if (auto Significance = GetWorld()->GetSubsystem<UTankSignificanceSubsystem>())
+		Significance->UnregisterTank(this);
+
+	if (auto SpatialHash = GetWorld()->GetSubsystem<UTankSpatialHashSubsystem>())
+		SpatialHash->UnregisterTank(this);
+
+	if (auto Outlines = GetWorld()->GetSubsystem<UTankOutlineSubsystem>())
+		Outlines->UnregisterTank(this);
+
 	if (PlayerController)
 	{
 		if (!PlayerController->OnShoot.IsBound())
@@ -183,6 +330,14 @@ void ATankCharacter::Tick(float DeltaTime)
 	if (!GetWorld())
 		return;
 
+	// the owner aims, everyone else follows the replicated aim state
+	if (!IsLocallyControlled())
+		InterpolateAimState(DeltaTime);
+
+	// every machine works the wheel speed out from its own copy of the vehicle's movement, nothing is sent for it
+	if (GetNetMode() != NM_DedicatedServer && GetVehicleMovementComponent())
+		SetSpeed(GetVehicleMovementComponent()->GetForwardSpeed());
+
 	// Only run trace logic for the local player or server, not unnecessary clients
 	if (HasAuthority() || IsLocallyControlled())
 	{
@@ -192,23 +347,98 @@ void ATankCharacter::Tick(float DeltaTime)
 			LookValues = PlayerController->GetLookValues();
 		}
 
+		// each task runs at the tier set in UTankTickSettings and gets the time since it last ran.
+		// tasks that are skipped this tick, e.g. while locked on, do not build up time.
+		float TaskDeltaTime;
+		bool bRequestTraces;
+
+		if (IsLocallyControlled() && ShouldRunTickTask(ETankTickTask::Highlighting, DeltaTime, TaskDeltaTime))
+		{
+			FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::Highlighting));
+			TankHighlightingComponent->HighlightEnemyTanksIfDetected();
+		}
+
 		if (HealthComponent)
 			if (HealthComponent->IsDead())
 				return;
 
 		if (LockedTarget == nullptr)
 		{
-			CameraTraceTick(DeltaTime);
-			TurretTraceTick();
-			UpdateTurretTurning(DeltaTime);
-			UpdateGunElevation(DeltaTime);
-			CheckIfGunCanLowerElevationTick(DeltaTime);
-			UpdateCameraPitchLimits();
+			if (ShouldRunAsyncTickTask(ETankTickTask::CameraTrace, DeltaTime, TaskDeltaTime, bRequestTraces))
+			{
+				FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::CameraTrace));
+				CameraTraceTick(TaskDeltaTime);
+			}
+
+			if (bRequestTraces)
+				RequestCameraTrace();
+
+			if (ShouldRunAsyncTickTask(ETankTickTask::TurretTrace, DeltaTime, TaskDeltaTime, bRequestTraces))
+			{
+				FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::TurretTrace));
+				TurretTraceTick();
+
+				if (HasAuthority() && !IsLocallyControlled())
+					UpdateAuthoritativeAimPoint();
+			}
+
+			if (bRequestTraces)
+				RequestTurretTrace();
+
+			if (ShouldRunTickTask(ETankTickTask::TurretTurning, DeltaTime, TaskDeltaTime))
+			{
+				FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::TurretTurning));
+				UpdateTurretTurning(TaskDeltaTime);
+			}
+
+			if (ShouldRunTickTask(ETankTickTask::GunElevation, DeltaTime, TaskDeltaTime))
+			{
+				FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::GunElevation));
+				UpdateGunElevation(TaskDeltaTime);
+			}
+
+			// MinGunElevation moves by MaxTurretElevationAdjustSpeed * TaskDeltaTime, so at a reduced rate the limit
+			// covers the same distance in fewer, bigger steps and only reacts a little later
+			if (ShouldRunAsyncTickTask(ETankTickTask::BarrelClearance, DeltaTime, TaskDeltaTime, bRequestTraces))
+			{
+				FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::BarrelClearance));
+				CheckIfGunCanLowerElevationTick(TaskDeltaTime);
+			}
+
+			if (bRequestTraces)
+				RequestBarrelTraces();
+
+			if (ShouldRunTickTask(ETankTickTask::CameraPitchLimits, DeltaTime, TaskDeltaTime))
+			{
+				FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::CameraPitchLimits));
+				UpdateCameraPitchLimits();
+			}
+		}
+
+		if (ShouldRunAsyncTickTask(ETankTickTask::ConeTrace, DeltaTime, TaskDeltaTime, bRequestTraces))
+		{
+			FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::ConeTrace));
+			ConeTraceTick();
+		}
+
+		if (bRequestTraces)
+			RequestConeQuery();
+
+		if (ShouldRunTickTask(ETankTickTask::AimAssist, DeltaTime, TaskDeltaTime))
+		{
+			FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::AimAssist));
+			TankAimAssistComponent->AimAssist(LockedTarget);
 		}
 
-		ConeTraceTick();
-		TankAimAssistComponent->AimAssist(LockedTarget);
-		CL_UpdateGunSightPosition();
+		// the owning client projects its own turret trace, nothing is sent for it
+		if (IsLocallyControlled() && ShouldRunTickTask(ETankTickTask::GunSight, DeltaTime, TaskDeltaTime))
+		{
+			FScopeCycleCounter CycleCounter(GetTickTaskStatId(ETankTickTask::GunSight));
+			UpdateGunSightPosition();
+		}
+
+		if (IsLocallyControlled() && !HasAuthority())
+			SendAimState();
 	}
 }
 
@@ -216,26 +446,114 @@ void ATankCharacter::TurretTraceTick_Implementation()
 {
 	if (!GetMesh())
 		return;
-	
-	constexpr double ShootTraceDistance = 15200.0;
 
 	TurretStart = GetMesh()->GetSocketLocation("GunShootSocket");
 	TurretEnd = TurretStart + GetMesh()->GetSocketQuaternion("Muzzle").GetForwardVector() * ShootTraceDistance;
-	
-	UKismetSystemLibrary::LineTraceSingle(
-		GetWorld(),
-		TurretStart,
-		TurretEnd,
-		TraceTypeQuery1,
-		false,
-		{this},
-		bShowDebugTracesForTurret ? EDrawDebugTrace::ForOneFrame : EDrawDebugTrace::None,
-		TurretTraceHit,
-		true,
-		FLinearColor::Red
+
+	// result of the trace requested on the last tick
+	ConsumeAsyncLineTrace(TurretTraceHandle, TurretTraceHit);
+}
+
+void ATankCharacter::RequestTurretTrace()
+{
+	if (!GetMesh())
+		return;
+
+	const FVector Start = GetMesh()->GetSocketLocation("GunShootSocket");
+	const FVector End = Start + GetMesh()->GetSocketQuaternion("Muzzle").GetForwardVector() * ShootTraceDistance;
+
+	TurretTraceHandle = RequestAsyncLineTrace(Start, End, true);
+}
+
+void ATankCharacter::RequestCameraTrace()
+{
+	const auto ActiveCamera = GetActiveCamera();
+	if (ActiveCamera == nullptr)
+		return;
+
+	const FVector Start = ActiveCamera->GetComponentLocation();
+	CameraTraceHandle = RequestAsyncLineTrace(Start, Start + ActiveCamera->GetForwardVector() * 15000.0, true);
+}
+
+void ATankCharacter::RequestBarrelTraces()
+{
+	if (!GetMesh())
+		return;
+
+	// along the top and the bottom of the barrel to check if it's colliding with anything
+	BarrelTopTraceHandle = RequestAsyncLineTrace(GetMesh()->GetSocketLocation("BarrelTraceStart"), GetMesh()->GetSocketLocation("BarrelTraceEnd"), false);
+	BarrelBottomTraceHandle = RequestAsyncLineTrace(GetMesh()->GetSocketLocation("BarrelTrace2Start"), GetMesh()->GetSocketLocation("BarrelTrace2End"), false);
+}
+
+void ATankCharacter::RequestConeQuery()
+{
+	if (ConeTraceConfigs.IsEmpty() || bConeTraceDisabled || !GetMesh())
+		return;
+
+	// only the targeting cone is queried, the others are only drawn
+	const FConeTraceConfig* Config = ConeTraceConfigs.FindByPredicate([](const FConeTraceConfig& Element) { return Element.bIsUsedForTankTargeting; });
+	if (!Config)
+		return;
+
+	// one axis trace and one capsule overlap instead of Steps sphere traces
+	ConeQueryHandle = UTFL::RequestConeOverlapVehiclesAsync(
+		GetWorld(), GetMesh()->GetSocketLocation(FName("Muzzle")),
+		GetMesh()->GetSocketQuaternion(FName("Muzzle")).GetForwardVector(),
+		Config->ConeLength, Config->StartRadius, Config->EndRadius,
+		{this}
 	);
 }
 
+void ATankCharacter::TraceTurretNow()
+{
+	if (!GetMesh())
+		return;
+
+	TurretStart = GetMesh()->GetSocketLocation("GunShootSocket");
+	TurretEnd = TurretStart + GetMesh()->GetSocketQuaternion("Muzzle").GetForwardVector() * ShootTraceDistance;
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(TurretTrace), false, this);
+	QueryParams.bReturnPhysicalMaterial = true;
+
+	GetWorld()->LineTraceSingleByChannel(TurretTraceHit, TurretStart, TurretEnd, ECC_Visibility, QueryParams);
+}
+
+FTraceHandle ATankCharacter::RequestAsyncLineTrace(const FVector& Start, const FVector& End, const bool bIgnoreSelf) const
+{
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(TankAsyncLineTrace), false, bIgnoreSelf ? this : nullptr);
+	QueryParams.bReturnPhysicalMaterial = true;
+
+	return GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, Start, End, ECC_Visibility, QueryParams);
+}
+
+bool ATankCharacter::ConsumeAsyncLineTrace(FTraceHandle& Handle, FHitResult& OutHit) const
+{
+	if (!Handle.IsValid())
+		return false;
+
+	FTraceDatum TraceData;
+	if (!GetWorld()->QueryTraceData(Handle, TraceData))
+	{
+		// results are only kept for one frame, request a new one if this one was missed
+		if (!GetWorld()->IsTraceHandleValid(Handle, false))
+			Handle = FTraceHandle();
+		return false;
+	}
+
+	Handle = FTraceHandle();
+	OutHit = TraceData.OutHits.IsEmpty() ? FHitResult(TraceData.Start, TraceData.End) : TraceData.OutHits[0];
+
+	if (bShowDebugTracesForTurret)
+	{
+		const FVector HitEnd = OutHit.bBlockingHit ? OutHit.ImpactPoint : TraceData.End;
+		TankDebugDraw::Line(GetWorld(), ETankDebugDrawChannel::TurretTraces, TraceData.Start, HitEnd, FColor::Red);
+		if (OutHit.bBlockingHit)
+			TankDebugDraw::Line(GetWorld(), ETankDebugDrawChannel::TurretTraces, HitEnd, TraceData.End, FColor::Green);
+	}
+
+	return true;
+}
+
 void ATankCharacter::SetWheelIndices()
 {
 	auto* MoveComp = Cast<UChaosWheeledVehicleMovementComponent>(GetVehicleMovementComponent());
@@ -312,8 +630,6 @@ void ATankCharacter::SetDefaults_Implementation()
 	SetWheelIndices();
 
 	VisibilityTraceType = UEngineTypes::ConvertToTraceType(ECC_Visibility);
-
-	Hits.Empty(10);
 }
 
 void ATankCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
@@ -362,7 +678,7 @@ void ATankCharacter::ResetCameraRotation_Implementation()
 		GetActorLocation() - FVector(0, 0, -2000),
 		TraceTypeQuery1,
 		false, {},
-		EDrawDebugTrace::ForDuration,
+		TankDebugDraw::TraceType(ETankDebugDrawChannel::SpawnPoints, EDrawDebugTrace::ForDuration),
 		OutHit,
 		true
 	);
@@ -390,76 +706,49 @@ void ATankCharacter::ConeTraceTick_Implementation()
 	const FVector StartLocation = SkeletalMeshComponent->GetSocketLocation(FName("Muzzle"));
 	const FVector Direction = SkeletalMeshComponent->GetSocketQuaternion(FName("Muzzle")).GetForwardVector();
 
-	// this is how big we want the initial array to be.
-	constexpr int SlackSize = 20;
-	
-	// Clear all previous hits before starting a new trace sequence
-	AllHits.Empty(SlackSize);
+	bool bTargetingConeQueried = false;
 
-	for (int i = 0; i < ConeTraceConfigs.Num(); ++i)
+	for (const FConeTraceConfig& Config : ConeTraceConfigs)
 	{
-		FConeTraceConfig& Config = ConeTraceConfigs[i];
-		auto End = StartLocation + Direction * Config.ConeLength;
-
-		bool bTraceBlockedByNonVehicle = false;
+		// Only one config should be used for targeting, the rest are only drawn
+		const bool bIsTargetingCone = Config.bIsUsedForTankTargeting && !bTargetingConeQueried;
 
-		for (int32 k = 0; k < Config.Steps; ++k)
+		if (bIsTargetingCone)
 		{
-			// Prevent division by zero when Config.Steps is 1
-			float Alpha = Config.Steps > 1 ? (float) k / (Config.Steps - 1) : 0;
-			
-			FVector SweepCenter = FMath::Lerp(
-				StartLocation,
-				End, Alpha == 1 || Alpha == 0 ? Alpha : FMath::Pow(Alpha, Config.CenterExponent)
-			);
-			
-			float Radius = FMath::Lerp(Config.StartRadius, Config.EndRadius, Alpha);
-
-			const auto bHit = UKismetSystemLibrary::SphereTraceMulti(
-				GetWorld(),
-				SweepCenter,
-				SweepCenter,
-				Radius,
-				VisibilityTraceType,
-				false,
-				{this},
-				bShowDebugTracesForTurret ? Config.DrawDebugTrace.GetValue() : EDrawDebugTrace::None,
-				Hits,
-				true,
-				Config.ConeTraceColor,
-				Config.ConeTraceHitColor
-			);
-
-			// Process hits for tank targeting if this config is used for targeting and if the array is not empty
-			if (Config.bIsUsedForTankTargeting && Hits.IsEmpty() == false)
-				for (const FHitResult& Hit : Hits)
-					if (Hit.GetActor()->GetRootComponent()->GetCollisionObjectType() == ECC_Vehicle)
-						AllHits.Add(Hit.GetActor());
-
-			// If we hit anything, check if we should break the trace sequence
-			if (bHit)
-			{
-				// Check for non-vehicle objects that would block the trace
-				for (const FHitResult& Hit : Hits)
-				{
-					if (Hit.GetActor()->GetRootComponent()->GetCollisionObjectType() != ECC_Vehicle)
-					{
-						bTraceBlockedByNonVehicle = true;
-						break;
-					}
-				}
-
-				if (bTraceBlockedByNonVehicle)
-					break; // Stop doing traces for this config as something non-vehicle is blocking
-			}
+			bTargetingConeQueried = true;
+
+			// the query RequestConeQuery made on the last tick. AllHits keeps the previous result until a new one is ready
+			float ConeLength;
+			if (UTFL::ConsumeConeOverlapVehicles(GetWorld(), ConeQueryHandle, AllHits, ConeLength))
+				ConeTraceLength = ConeLength;
+
+			if (TankTargetingSystem)
+				LockedTarget = TankTargetingSystem->ProcessHitResults(AllHits);
 		}
 
-		// Process Hits as needed for this config
-		if (Config.bIsUsedForTankTargeting && TankTargetingSystem)
+#if TANK_DEBUG_DRAW
+		// the steps only decide where the debug spheres are drawn now
+		if (bShowDebugTracesForTurret && Config.DrawDebugTrace != EDrawDebugTrace::None
+			&& TankDebugDraw::IsChannelEnabled(ETankDebugDrawChannel::ConeTrace))
 		{
-			LockedTarget = TankTargetingSystem->ProcessHitResults(AllHits);
-			AllHits.Empty(SlackSize); // Clear hits after processing for this config
+			const float ConeLength = bIsTargetingCone ? ConeTraceLength : Config.ConeLength;
+			const FColor Color = (bIsTargetingCone && !AllHits.IsEmpty() ? Config.ConeTraceHitColor : Config.ConeTraceColor).ToFColor(true);
+
+			for (int32 k = 0; k < Config.Steps; ++k)
+			{
+				// Prevent division by zero when Config.Steps is 1
+				const float Alpha = Config.Steps > 1 ? (float) k / (Config.Steps - 1) : 0;
+				const float CenterAlpha = Alpha == 1 || Alpha == 0 ? Alpha : FMath::Pow(Alpha, Config.CenterExponent);
+
+				if (CenterAlpha * Config.ConeLength > ConeLength)
+					break;
+
+				TankDebugDraw::Sphere(GetWorld(), ETankDebugDrawChannel::ConeTrace,
+				                      StartLocation + Direction * Config.ConeLength * CenterAlpha,
+				                      FMath::Lerp(Config.StartRadius, Config.EndRadius, Alpha), 12, Color);
+			}
 		}
+#endif
 	}
 }
 
@@ -573,17 +862,25 @@ void ATankCharacter::UpdateDesiredTurretAngle()
 	SetDesiredTurretAngle(FMath::FInterpTo(CurrentTurretAngle, DesiredTurretAngle_C, GetWorld()->GetDeltaSeconds(), 10));
 }
 
-void ATankCharacter::CL_UpdateGunSightPosition_Implementation()
+void ATankCharacter::UpdateGunSightPosition()
 {
-	if (IsAimingIn())
+	if (!IsLocallyControlled() || IsAimingIn())
 		return;
 
 	if (GunSightWidget)
 	{
+		FVector AimPoint = TurretTraceHit.bBlockingHit ? TurretTraceHit.ImpactPoint : TurretTraceHit.TraceEnd;
+
+		// the server decides where the shot stops. while it agrees on the line of fire, e.g. it only sees something
+		// in the way that we do not, its aim point wins. while turning it is behind and off the line, so it is ignored.
+		if (!HasAuthority() && !AuthoritativeAimPoint.IsZero()
+			&& FMath::PointDistToSegment(AuthoritativeAimPoint, TurretTraceHit.TraceStart, TurretTraceHit.TraceEnd) <= AimPointReplicationThreshold)
+			AimPoint = AuthoritativeAimPoint;
+
 		FVector2D ScreenPosition;
 		UWidgetLayoutLibrary::ProjectWorldLocationToWidgetPosition(
 			PlayerController,
-			TurretTraceHit.bBlockingHit ? TurretTraceHit.ImpactPoint : TurretTraceHit.TraceEnd,
+			AimPoint,
 			ScreenPosition,
 			true
 		);
@@ -592,6 +889,15 @@ void ATankCharacter::CL_UpdateGunSightPosition_Implementation()
 	}
 }
 
+void ATankCharacter::UpdateAuthoritativeAimPoint()
+{
+	const FVector AimPoint = TurretTraceHit.bBlockingHit ? TurretTraceHit.ImpactPoint : TurretTraceHit.TraceEnd;
+
+	// an unchanged property is never resent, so small movements cost nothing
+	if (FVector::DistSquared(AimPoint, AuthoritativeAimPoint) > FMath::Square(AimPointReplicationThreshold))
+		AuthoritativeAimPoint = AimPoint;
+}
+
 void ATankCharacter::SetDesiredTurretAngle(float TurretAngle)
 {
 	DesiredTurretAngle_C = TurretAngle;
@@ -604,39 +910,14 @@ void ATankCharacter::CheckIfGunCanLowerElevationTick_Implementation(float DeltaT
 
 	double OldMinTurretElevation = MinGunElevation;
 	
-	FVector TopTraceStart = GetMesh()->GetSocketLocation("BarrelTraceStart");
-	FVector TopTraceEnd = GetMesh()->GetSocketLocation("BarrelTraceEnd");
-	FHitResult TopHit;
-
-	// Perform a trace along the bottom of the barrel to check if it's colliding with anything
-	const bool bTopHit = UKismetSystemLibrary::LineTraceSingle(
-		GetWorld(),
-		TopTraceStart,
-		TopTraceEnd,
-		TraceTypeQuery1,
-		false,
-		{},
-		bShowDebugTracesForTurret ? EDrawDebugTrace::ForOneFrame : EDrawDebugTrace::None,
-		TopHit,
-		false
-	);
-
-	FVector BottomTraceStart = GetMesh()->GetSocketLocation("BarrelTrace2Start");
-	FVector BottomTraceEnd = GetMesh()->GetSocketLocation("BarrelTrace2End");
-	FHitResult BottomHit;
+	// both barrel traces are async, RequestBarrelTraces made them on the last tick
+	ConsumeAsyncLineTrace(BarrelTopTraceHandle, BarrelTopHit);
+	ConsumeAsyncLineTrace(BarrelBottomTraceHandle, BarrelBottomHit);
 
-	// Perform a trace along the bottom of the barrel to check if it's colliding with anything
-	const bool bBottomHit = UKismetSystemLibrary::LineTraceSingle(
-		GetWorld(),
-		BottomTraceStart,
-		BottomTraceEnd,
-		TraceTypeQuery1,
-		false,
-		{},
-		bShowDebugTracesForTurret ? EDrawDebugTrace::ForOneFrame : EDrawDebugTrace::None,
-		BottomHit,
-		false
-	);
+	const FHitResult& TopHit = BarrelTopHit;
+	const FHitResult& BottomHit = BarrelBottomHit;
+	const bool bTopHit = TopHit.bBlockingHit;
+	const bool bBottomHit = BottomHit.bBlockingHit;
 
 	// disable the players ability to shoot while the turret is adjusting
 	if (bBottomHit == true && bTopHit == false || bBottomHit == true && bTopHit == true)
@@ -710,19 +991,11 @@ void ATankCharacter::CameraTraceTick_Implementation(float DeltaTime)
 	ActiveCameraStart = ActiveCamera->GetComponentLocation();
 	ActiveCameraEnd = ActiveCameraStart + (ActiveCamera->GetForwardVector() * 15000.0);
 	
-	auto bHit = UKismetSystemLibrary::LineTraceSingle(
-		GetWorld(),
-		ActiveCameraStart,
-		ActiveCameraEnd,
-		TraceTypeQuery1, // should be visibility
-		false,
-		{this},
-		bShowDebugTracesForTurret ? EDrawDebugTrace::ForOneFrame : EDrawDebugTrace::None,
-		CameraTraceHit,
-		true
-	);
-	
-	DesiredCameraImpactPoint = bHit ? CameraTraceHit.ImpactPoint : ActiveCameraEnd;
+	// result of the trace requested on the last tick
+	ConsumeAsyncLineTrace(CameraTraceHandle, CameraTraceHit);
+
+	// the hit is a frame old, the interpolation below hides that. a miss uses this frame's end
+	DesiredCameraImpactPoint = CameraTraceHit.bBlockingHit ? CameraTraceHit.ImpactPoint : ActiveCameraEnd;
 	CameraImpactPoint = FMath::VInterpTo(CameraImpactPoint, DesiredCameraImpactPoint, DeltaTime, 30);
 }
 
@@ -754,6 +1027,9 @@ void ATankCharacter::UpdateGunElevation_Implementation(float DeltaTime)
 	
 	SetGunElevation(GunElevation);
 
+	if (!TankDebugDraw::IsChannelEnabled(ETankDebugDrawChannel::GunElevation))
+		return;
+
 	UKismetSystemLibrary::PrintString(GetWorld(), FString::Printf(TEXT("(ATankCharacter::UpdateGunElevation) Start: [%s]"), *ActiveCameraStart.ToString()),
 									  true, true, FLinearColor::White, 0);
 	
@@ -822,33 +1098,9 @@ void ATankCharacter::UpdateCameraPitchLimits_Implementation() const
 
 void ATankCharacter::OutlineTank_Implementation(const bool bActivate, const bool bIsFriend)
 {
-	if (!GetMesh())
-		return;
-	
-	if (bActivate)
-	{
-		if (bIsFriend)
-		{
-			if (GetMesh()->CustomDepthStencilValue == 0 && GetMesh()->CustomDepthStencilValue != FriendStencilValue)
-			{
-				GetMesh()->SetCustomDepthStencilValue(FriendStencilValue);
-			}
-		}
-		else
-		{
-			if (GetMesh()->CustomDepthStencilValue != FriendStencilValue && GetMesh()->CustomDepthStencilValue != EnemyStencilValue)
-			{
-				GetMesh()->SetCustomDepthStencilValue(EnemyStencilValue);
-			}
-		}
-	}
-	else
-	{
-		if (GetMesh()->CustomDepthStencilValue == EnemyStencilValue && GetMesh()->CustomDepthStencilValue != 0)
-		{
-			GetMesh()->SetCustomDepthStencilValue(0);
-		}
-	}
+	// the stencil is written by the outline subsystem once a frame, and only when it changes
+	if (auto Outlines = GetWorld()->GetSubsystem<UTankOutlineSubsystem>())
+		Outlines->SetOutline(this, bActivate, bIsFriend);
 }
 
 ETeam ATankCharacter::GetCurrentTeam_Implementation()
@@ -867,8 +1119,30 @@ void ATankCharacter::ProjectileHit_Implementation(ATankProjectile* TankProjectil
 {
 	IShootingInterface::ProjectileHit_Implementation(TankProjectile, HitComponent, OtherActor, OtherComp, NormalImpulse, Hit);
 
-	SR_ApplyRadialDamage(Hit);
-	TankProjectile->ResetTransform();
+	// every machine flies its own copy of the shell, the server's decides the hit in ShotHit
+
+	// null for shells simulated by UTankBallisticsSubsystem
+	if (TankProjectile)
+		TankProjectile->ResetTransform();
+}
+
+void ATankCharacter::ShotHit(const uint16 ShotId, const FHitResult& Hit)
+{
+	if (HasAuthority())
+		MC_ConfirmShotHit(ShotId, Hit.Location);
+}
+
+void ATankCharacter::MC_ConfirmShotHit_Implementation(const uint16 ShotId, const FVector_NetQuantize& Location)
+{
+	// our copy may still be in flight, or already hit somewhere close by
+	auto GameMode = Cast<ATankGameState>(UGameplayStatics::GetGameState(GetWorld()));
+	if (GameMode != nullptr && GameMode->ProjectilePool != nullptr)
+		GameMode->ProjectilePool->StopShot(this, ShotId, Location);
+
+	FHitResult Hit;
+	Hit.Location = Location;
+	Hit.ImpactPoint = Location;
+	ApplyRadialDamage(Hit);
 }
 
 void ATankCharacter::ApplyRadialImpulseToObjects_Implementation(const FHitResult& Hit)
@@ -915,17 +1189,21 @@ void ATankCharacter::ApplyRadialImpulseToObjects_Implementation(const FHitResult
 
 void ATankCharacter::ApplyRadialDamage_Implementation(const FHitResult& Hit)
 {
-	UGameplayStatics::ApplyRadialDamageWithFalloff(GetWorld(),
+	// the tanks in range come from UTankSpatialHashSubsystem instead of an overlap of every dynamic object
+	TArray<TTuple<AActor*, double>> HitActors;
+	UTFL::ApplyRadialDamageWithFalloff(GetWorld(),
 	                                   BaseDamage, BaseDamage * 0.1, Hit.Location,
 	                                   DamageInnerRadius, DamageOuterRadius, DamageFalloffExponent, UTankDamageType::StaticClass(),
-	                                   {}, this, GetController());
+	                                   {}, HitActors, this, GetController());
 
 	ApplyRadialImpulseToObjects(Hit);
 }
 
-void ATankCharacter::SR_ApplyRadialDamage_Implementation(const FHitResult& Hit)
+void ATankCharacter::SR_ApplyRadialDamage(const FHitResult& Hit)
 {
-	MC_ApplyRadialDamage(Hit);
+	// a client asking for damage at any hit is what the hit confirmation replaced
+	if (HasAuthority())
+		MC_ApplyRadialDamage(Hit);
 }
 
 void ATankCharacter::MC_ApplyRadialDamage_Implementation(const FHitResult& Hit)
@@ -978,6 +1256,10 @@ void ATankCharacter::Restart__Internal()
 	if (HealthComponent)
 		HealthComponent->OnPlayerRespawn();
 
+	// refresh everything on the first tick after respawning, including the OnEvent tasks
+	for (int32 i = 0; i < TickTasks.Num(); ++i)
+		RequestTickTask(static_cast<ETankTickTask>(i));
+
 	SetActorTickEnabled(true);
 }
 
@@ -1015,63 +1297,220 @@ void ATankCharacter::ApplyTankShootImpulse_Implementation() const
 	GetMesh()->AddAngularImpulseInDegrees(AngularImpulse, NAME_None, true);
 }
 
-void ATankCharacter::SpawnProjectileFromPool()
+void ATankCharacter::SpawnProjectileFromPool(const FVector& Start, const FVector& End)
 {
 	auto GameMode = Cast<ATankGameState>(UGameplayStatics::GetGameState(GetWorld()));
-		
-	if (GameMode != nullptr)
+
+	if (GameMode == nullptr || GameMode->ProjectilePool == nullptr)
+		return;
+
+	const FProjectileSpawnParams Params(Start, End - Start, ShellSpeed, GameMode->ProjectilePool->GetServerTime(), NextShotId++);
+
+	// fired here straight away, the server and the other clients fly their own copies
+	FireProjectile(Params);
+	SR_FireProjectile(Params);
+}
+
+void ATankCharacter::FireProjectile(const FProjectileSpawnParams& Params)
+{
+	auto GameMode = Cast<ATankGameState>(UGameplayStatics::GetGameState(GetWorld()));
+
+	if (GameMode != nullptr && GameMode->ProjectilePool != nullptr)
+		GameMode->ProjectilePool->SpawnFromParams(Params, this);
+}
+
+void ATankCharacter::SR_FireProjectile_Implementation(const FProjectileSpawnParams& Params)
+{
+	// the server's copy of this shell decides the hit, so nothing in it is taken from the client as is
+	if (!IsProjectileOriginValid(Params) || !TryConsumeServerShot())
+		return;
+
+	FProjectileSpawnParams ServerParams = Params;
+	ServerParams.Speed = ShellSpeed;
+
+	auto GameMode = Cast<ATankGameState>(UGameplayStatics::GetGameState(GetWorld()));
+	if (GameMode != nullptr && GameMode->ProjectilePool != nullptr)
 	{
-		if (GameMode->ProjectilePool != nullptr)
-		{
-			auto Rot = UKismetMathLibrary::FindLookAtRotation(TurretTraceHit.TraceStart, TurretTraceHit.TraceEnd);
-			GameMode->ProjectilePool->SpawnFromPool(FTransform(Rot, TurretTraceHit.TraceEnd), this);
-		}
+		// a shot can not be older than lag compensation would rewind for it
+		const auto LagCompensation = GetWorld()->GetSubsystem<UTankLagCompensationSubsystem>();
+		const double Now = GameMode->ProjectilePool->GetServerTime();
+		const double MaxRewindTime = LagCompensation ? LagCompensation->GetMaxRewindTime() : 0.0;
+		ServerParams.ServerTime = FMath::Clamp(Params.ServerTime, Now - MaxRewindTime, Now);
 	}
+
+	MC_FireProjectile(ServerParams);
 }
 
-void ATankCharacter::OnShoot_Implementation()
+bool ATankCharacter::TryConsumeServerShot()
 {
-	// Spawning muzzle fire and dust around the tank 
-	SR_SpawnShootEmitters();
+	const double Cooldown = PlayerController ? PlayerController->GetShootTimerDuration() - ServerShotCooldownTolerance : 0.0;
+	const double Now = GetWorld()->GetTimeSeconds();
 
-	// check if trace hit something. the trace is running on tick in another function
-	if (TurretTraceHit.IsValidBlockingHit())
+	if (Now - LastServerShotTime < Cooldown)
 	{
-		SpawnHitParticleSystem(TurretTraceHit);
-		SR_ApplyRadialDamage(TurretTraceHit);
+		UE_LOG(LogTemp, Warning, TEXT("(ATankCharacter::TryConsumeServerShot) %s: rejected shot, %.2fs after the last one"),
+		       *GetName(), Now - LastServerShotTime);
+		return false;
 	}
+
+	LastServerShotTime = Now;
+	return true;
+}
+
+bool ATankCharacter::IsProjectileOriginValid(const FProjectileSpawnParams& Params) const
+{
+	const FVector ServerMuzzle = GetMesh()->GetSocketLocation("GunShootSocket");
+	const FVector Direction = Params.Direction;
+
+	if (FVector::Distance(Params.Origin, ServerMuzzle) <= MaxMuzzleError)
+		return true;
+
+	// a shot whose trace hit nothing continues from the end of the trace, which has to be clear on the server too
+	const FVector TraceEnd = ServerMuzzle + Direction * ShootTraceDistance;
+	if (FVector::Distance(Params.Origin, TraceEnd) <= MaxMuzzleError
+		&& !GetWorld()->LineTraceTestByChannel(ServerMuzzle, Params.Origin, ECC_Visibility, FCollisionQueryParams(SCENE_QUERY_STAT(TurretTrace), false, this)))
+		return true;
+
+	UE_LOG(LogTemp, Warning, TEXT("(ATankCharacter::IsProjectileOriginValid) %s: rejected shot, origin is %.0f away from the server's muzzle"),
+	       *GetName(), FVector::Distance(Params.Origin, ServerMuzzle));
+	return false;
+}
+
+void ATankCharacter::MC_FireProjectile_Implementation(const FProjectileSpawnParams& Params)
+{
+	if (IsLocallyControlled())
+		return;
+
+	FireProjectile(Params);
+}
+
+double ATankCharacter::GetShotViewTime() const
+{
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+	const double ServerTime = GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+
+	// other tanks are shown roughly half a round trip behind the server
+	if (!HasAuthority() && GetPlayerState())
+		return ServerTime - GetPlayerState()->GetPingInMilliseconds() * 0.0005;
+
+	return ServerTime;
+}
+
+void ATankCharacter::SR_ConfirmHitscanShot_Implementation(const FVector_NetQuantize& Start, const FVector_NetQuantize& End, const double ViewTime)
+{
+	// the shot has to come from roughly where the server has our gun
+	const FVector ServerMuzzle = GetMesh()->GetSocketLocation("GunShootSocket");
+	if (FVector::Distance(Start, ServerMuzzle) > MaxMuzzleError)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("(ATankCharacter::SR_ConfirmHitscanShot) %s: rejected shot, muzzle is %.0f away from the server's"),
+		       *GetName(), FVector::Distance(Start, ServerMuzzle));
+		return;
+	}
+
+	if (BallisticsMode == ETankBallisticsMode::Projectile || !TryConsumeServerShot())
+		return;
+
+	// only the direction is taken from the client, the range is the server's
+	const FVector ServerEnd = Start + (End - Start).GetSafeNormal() * ShootTraceDistance;
+
+	FHitResult ServerHit;
+	bool bHit;
+
+	if (auto LagCompensation = GetWorld()->GetSubsystem<UTankLagCompensationSubsystem>())
+		bHit = LagCompensation->RewindLineTrace(this, Start, ServerEnd, ViewTime, ServerHit);
 	else
+		bHit = GetWorld()->LineTraceSingleByChannel(ServerHit, Start, ServerEnd, ECC_Visibility, FCollisionQueryParams(NAME_None, false, this));
+
+	if (!bHit)
+		return;
+
+	// in Auto mode anything further away has to be fired as a projectile. MaxMuzzleError covers the client's and server's traces not matching exactly.
+	if (BallisticsMode == ETankBallisticsMode::Auto && ServerHit.Distance > HitscanTimeThreshold * ShellSpeed + MaxMuzzleError)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("(ATankCharacter::SR_ConfirmHitscanShot) %s: rejected shot, %.0f is too far for hitscan"),
+		       *GetName(), ServerHit.Distance);
+		return;
+	}
+
+	MC_ApplyRadialDamage(ServerHit);
+}
+
+void ATankCharacter::ResolveHitscanShot(const FHitResult& Hit, const double TimeToImpact)
+{
+	// the server decides the hit, the client only shows its own prediction of it
+	SR_ConfirmHitscanShot(Hit.TraceStart, Hit.TraceEnd, GetShotViewTime());
+
+	if (TimeToImpact <= UE_KINDA_SMALL_NUMBER)
 	{
-		// spawn projectile for the rest of the way.
-		SpawnProjectileFromPool();
+		SpawnHitParticleSystem(Hit);
+		return;
+	}
+
+	FFlow::Delay(this, TimeToImpact, [this, Hit]
+	{
+		SpawnHitParticleSystem(Hit);
+	});
+}
+
+void ATankCharacter::OnShoot_Implementation()
+{
+	// Spawning muzzle fire and dust around the tank 
+	SR_SpawnShootEmitters();
+
+	// the trace on tick is async and a frame behind, so trace again from where the gun is right now
+	TraceTurretNow();
+
+	const bool bTraceHit = TurretTraceHit.IsValidBlockingHit();
+	const double TimeToImpact = bTraceHit ? TurretTraceHit.Distance / ShellSpeed : TNumericLimits<double>::Max();
+	const FVector& TraceStart = TurretTraceHit.TraceStart;
+	const FVector& TraceEnd = TurretTraceHit.TraceEnd;
+
+	switch (BallisticsMode)
+	{
+	case ETankBallisticsMode::Auto:
+		if (TimeToImpact <= HitscanTimeThreshold)
+			ResolveHitscanShot(TurretTraceHit, TimeToImpact);
+		else if (bTraceHit)
+			SpawnProjectileFromPool(TraceStart, TurretTraceHit.ImpactPoint); // too far for hitscan, fly the whole way
+		else
+			SpawnProjectileFromPool(TraceEnd, TraceEnd + (TraceEnd - TraceStart)); // nothing in trace range, continue from its end
+		break;
+
+	case ETankBallisticsMode::Hitscan:
+		if (bTraceHit)
+			ResolveHitscanShot(TurretTraceHit, TimeToImpact);
+		else
+			SpawnProjectileFromPool(TraceEnd, TraceEnd + (TraceEnd - TraceStart));
+		break;
+
+	case ETankBallisticsMode::Projectile:
+		SpawnProjectileFromPool(TraceStart, TraceEnd);
+		break;
 	}
 
 	ApplyTankShootImpulse();
 }
 
-void ATankCharacter::SetGunElevation(const double NewGunElevation) const
+void ATankCharacter::SetGunElevation(const double NewGunElevation)
 {
-	if (AnimInstance == nullptr)
+	// only the owner decides where it aims
+	if (AnimInstance == nullptr || !IsLocallyControlled())
 		return;
-	
+
+	AnimInstance->GunElevation = NewGunElevation;
+
 	if (HasAuthority())
-		AnimInstance->GunElevation = NewGunElevation;
-	else
-		SR_SetGunElevation(NewGunElevation);
+		AimState.Set(AnimInstance->TurretAngle, AnimInstance->GunElevation);
 }
 
 void ATankCharacter::SpawnHitParticleSystem(const FHitResult& Hit) const
 {
-	UNiagaraFunctionLibrary::SpawnSystemAtLocation(
-		GetWorld(),
-		ShootHitParticleSystem,
-		Hit.Location,
-		Hit.Normal.Rotation(), // rotate to match hit surface
-		FVector(1),
-		true,
-		true,
-		ENCPoolMethod::AutoRelease
-	);
+	if (auto VFX = GetWorld()->GetSubsystem<UTankVFXSubsystem>())
+		VFX->SpawnNiagaraAtLocation(
+			ShootHitParticleSystem,
+			Hit.Location,
+			Hit.Normal.Rotation() // rotate to match hit surface
+		);
 
 	// DrawDebugSphere(GetWorld(),
 	// 	Hit.Location, 75, 16,
@@ -1081,48 +1520,52 @@ void ATankCharacter::SpawnHitParticleSystem(const FHitResult& Hit) const
 	// UGameplayStatics::SetGamePaused(GetWorld(), true);
 }
 
-void ATankCharacter::SR_SetGunElevation_Implementation(double NewGunElevation) const
+void ATankCharacter::SetTurretRotation(const double NewTurretAngle)
 {
-	if (AnimInstance == nullptr)
+	// only the owner decides where it aims
+	if (AnimInstance == nullptr || !IsLocallyControlled())
 		return;
 
-	AnimInstance->GunElevation = NewGunElevation;
-
-	MC_SetGunElevation(NewGunElevation);
-}
+	AnimInstance->TurretAngle = NewTurretAngle;
 
-void ATankCharacter::MC_SetGunElevation_Implementation(double NewGunElevation) const
-{
-	if (AnimInstance)
-		AnimInstance->GunElevation = NewGunElevation;
+	if (HasAuthority())
+		AimState.Set(AnimInstance->TurretAngle, AnimInstance->GunElevation);
 }
 
-void ATankCharacter::SetTurretRotation(const double NewTurretAngle) const
+void ATankCharacter::SendAimState()
 {
 	if (AnimInstance == nullptr)
 		return;
-	
-	if (HasAuthority())
-		AnimInstance->TurretAngle = NewTurretAngle;
-	else
-		SR_SetTurretRotation(NewTurretAngle);
-}
 
-void ATankCharacter::SR_SetTurretRotation_Implementation(double NewTurretAngle) const
-{
-	if (AnimInstance == nullptr)
+	FTankAimState NewAimState;
+	NewAimState.Set(AnimInstance->TurretAngle, AnimInstance->GunElevation);
+
+	// the rpc is unreliable, so an unchanged state is still resent now and then in case the last change was dropped
+	const double Now = GetWorld()->GetTimeSeconds();
+	if (NewAimState == SentAimState && Now - LastAimStateSendTime < AimStateResendInterval)
 		return;
 
-	AnimInstance->TurretAngle = NewTurretAngle;
-	MC_SetTurretRotation(NewTurretAngle);
+	SR_SetAimState(NewAimState);
+	SentAimState = NewAimState;
+	LastAimStateSendTime = Now;
 }
 
-void ATankCharacter::MC_SetTurretRotation_Implementation(double NewTurretAngle) const
+void ATankCharacter::SR_SetAimState_Implementation(const FTankAimState& NewAimState)
+{
+	AimState = NewAimState;
+}
+
+void ATankCharacter::InterpolateAimState(const float DeltaTime)
 {
 	if (AnimInstance == nullptr)
 		return;
-	
-	AnimInstance->TurretAngle = NewTurretAngle;
+
+	// shortest way around, the turret can spin past 180
+	const double TurretDelta = FMath::FindDeltaAngleDegrees(AnimInstance->TurretAngle, AimState.GetTurretAngle());
+	AnimInstance->TurretAngle = FRotator::NormalizeAxis(AnimInstance->TurretAngle + FMath::FInterpTo(0.0, TurretDelta, DeltaTime, AimStateInterpSpeed));
+	AnimInstance->GunElevation = FMath::FInterpTo(AnimInstance->GunElevation, AimState.GetGunElevation(), DeltaTime, AimStateInterpSpeed);
+
+	CurrentTurretAngle = AnimInstance->TurretAngle;
 }
 
 void ATankCharacter::SetSkinType(const double NewSkinType) const
@@ -1131,60 +1574,55 @@ void ATankCharacter::SetSkinType(const double NewSkinType) const
 		BodyMaterial->SetScalarParameterValue("SkinType", NewSkinType);
 }
 
-void ATankCharacter::SetLightsEmissivity(double LightsEmissivity) const
+void ATankCharacter::SetLightsEmissivity(const double LightsEmissivity)
 {
-	if (BodyMaterial == nullptr)
-		return;
+	CurrentLightsEmissivity = LightsEmissivity;
 
-	BodyMaterial->SetScalarParameterValue("EmissiveMultiplier", LightsEmissivity);
-	SR_SetLightsEmissivity(LightsEmissivity);
+	if (BodyMaterial && bCosmeticsEnabled)
+		BodyMaterial->SetScalarParameterValue("EmissiveMultiplier", CurrentLightsEmissivity);
 }
 
-void ATankCharacter::SR_SetLightsEmissivity_Implementation(double LightsEmissivity) const
+void ATankCharacter::SR_SetLightsEmissivity(const double LightsEmissivity)
 {
-	if (BodyMaterial == nullptr)
-		return;
-	
-	BodyMaterial->SetScalarParameterValue("EmissiveMultiplier", LightsEmissivity);
-	MC_SetLightsEmissivity(LightsEmissivity);
+	SetLightsEmissivity(LightsEmissivity);
 }
 
-void ATankCharacter::MC_SetLightsEmissivity_Implementation(double LightsEmissivity) const
+void ATankCharacter::MC_SetLightsEmissivity(const double LightsEmissivity)
 {
-	if (BodyMaterial == nullptr)
-		return;
-	
-	BodyMaterial->SetScalarParameterValue("EmissiveMultiplier", LightsEmissivity);
+	SetLightsEmissivity(LightsEmissivity);
 }
 
-void ATankCharacter::SetSpeed(double Speed)
+void ATankCharacter::MC_SetWheelSmoke(const float Intensity)
 {
-	if (AnimInstance == nullptr)
-		return;
-	
-	if (HasAuthority())
-	{
-		AnimInstance->WheelSpeed = Speed;
-		SetWheelSmoke(!bIsInAir ? Speed : 0);
-	}
-	else
-	{
-		SR_SetSpeed(Speed);
-	}
+	if (bWheelSmokeEnabled)
+		SetWheelSmoke(Intensity);
 }
 
-void ATankCharacter::SR_SetSpeed_Implementation(double Speed)
+void ATankCharacter::SetCosmeticsEnabled(const bool bInWheelSmokeEnabled, const bool bInCosmeticsEnabled)
 {
-	MC_SetSpeed(Speed);
+	if (bWheelSmokeEnabled && !bInWheelSmokeEnabled)
+		SetWheelSmoke(0);
+
+	// catch up on what was skipped while cosmetics were off
+	if (!bCosmeticsEnabled && bInCosmeticsEnabled && BodyMaterial)
+		BodyMaterial->SetScalarParameterValue("EmissiveMultiplier", CurrentLightsEmissivity);
+
+	bWheelSmokeEnabled = bInWheelSmokeEnabled;
+	bCosmeticsEnabled = bInCosmeticsEnabled;
+
+	if (AnimInstance)
+		AnimInstance->bUpdateHatches = bCosmeticsEnabled;
 }
 
-void ATankCharacter::MC_SetSpeed_Implementation(double Speed)
+void ATankCharacter::SetSpeed(double Speed)
 {
 	if (AnimInstance == nullptr)
 		return;
-	
+
 	AnimInstance->WheelSpeed = Speed;
-	SetWheelSmoke(!bIsInAir ? Speed : 0);
+
+	if (bWheelSmokeEnabled)
+		SetWheelSmoke(!bIsInAir ? Speed : 0);
 }
 
 void ATankCharacter::SetHatchesAngles(double HatchAngle) const
@@ -1260,11 +1698,6 @@ void ATankCharacter::SR_SpawnShootEmitters_Implementation()
 	MC_SpawnShootEmitters();
 }
 
-void ATankCharacter::MC_SetWheelSmoke_Implementation(float Intensity)
-{
-	SetWheelSmoke(Intensity);
-}
-
 void ATankCharacter::MC_SetHatchesAngles_Implementation(double HatchAngle)
 {
 	SetHatchesAngles(HatchAngle);
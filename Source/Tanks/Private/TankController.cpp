@@ -12,6 +12,7 @@
 #include "Camera/CameraComponent.h"
 #include "Components/TankHealthComponent.h"
 #include "GameFramework/SpringArmComponent.h"
+#include "Net/UnrealNetwork.h"
 
 const FName FirstPersonSocket = FName("FirstPersonSocket");
 
@@ -22,10 +23,16 @@ ATankController::ATankController(): PrevTurnInput(0), LookValues(), MoveValues()
                                     DecelerationRate(500),
                                     ShootTimerDuration(3),
                                     MouseSensitivity(0.4),
+                                    InputSendRate(30),
+                                    MaxInputFramesPerBatch(8),
                                     bIsAlive(true),
                                     bStopTurn(false),
                                     VehicleYaw(0),
-                                    bCanShoot(true), bShootingBlocked(false)
+                                    bCanShoot(true), bShootingBlocked(false),
+                                    NextInputFrame(1),
+                                    InputSendTime(0),
+                                    bForceInputFrame(false),
+                                    AckedInputFrame(0)
 {
 	if (TankCameraManagerClass)
 		PlayerCameraManagerClass = TankCameraManagerClass;
@@ -152,11 +159,9 @@ void ATankController::HandleVehicleDeceleration()
 
 void ATankController::RefreshTankPlayerState()
 {
+	// the wheel speed is worked out by the tank itself on every machine
 	if (TankPlayer && bIsAlive && VehicleMovementComponent)
-	{
 		bStopTurn = TankPlayer->GetMesh()->GetPhysicsAngularVelocityInDegrees().Length() > 30.0;
-		TankPlayer->SetSpeed(VehicleMovementComponent->GetForwardSpeed());
-	}
 
 	if (TankPlayer && TankPlayer->GetHealthComponent())
 	{
@@ -172,6 +177,79 @@ void ATankController::Tick(float DeltaSeconds)
     RefreshTankPlayerState();
     ClampVehicleSpeed();
     HandleVehicleDeceleration();
+
+    if (IsLocalController() && !HasAuthority())
+        SendInputFrames(DeltaSeconds);
+}
+
+void ATankController::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(ThisClass, AckedInputFrame, COND_OwnerOnly);
+}
+
+void ATankController::SendInputFrames(const float DeltaSeconds)
+{
+	// the server has these already
+	UnackedInputFrames.RemoveAll([this](const FTankInputFrame& Frame) { return !FTankInputFrame::IsNewerThan(Frame.Frame, AckedInputFrame); });
+
+	InputSendTime += DeltaSeconds;
+	if (InputSendTime < 1.0 / InputSendRate)
+		return;
+
+	InputSendTime = 0;
+
+	// one frame per send, nothing at all while idle and acknowledged
+	const FTankInputFrame Frame(NextInputFrame, MoveValues.Y, MoveValues.X);
+	const bool bRecordFrame = bForceInputFrame || !Frame.HasSameInput(LastInputFrame);
+	if (!bRecordFrame && UnackedInputFrames.IsEmpty())
+		return;
+
+	if (bRecordFrame)
+	{
+		UnackedInputFrames.Add(Frame);
+		LastInputFrame = Frame;
+		++NextInputFrame;
+		bForceInputFrame = false;
+	}
+
+	if (UnackedInputFrames.Num() > MaxInputFramesPerBatch)
+		UnackedInputFrames.RemoveAt(0, UnackedInputFrames.Num() - MaxInputFramesPerBatch, EAllowShrinking::No);
+
+	SR_SendInputFrames(UnackedInputFrames);
+}
+
+void ATankController::SR_SendInputFrames_Implementation(const TArray<FTankInputFrame>& Frames)
+{
+	// frames are oldest first, some of them may have been applied from an earlier batch
+	for (const FTankInputFrame& Frame : Frames)
+	{
+		if (!FTankInputFrame::IsNewerThan(Frame.Frame, AckedInputFrame))
+			continue;
+
+		// e.g. dead or respawning. left unacknowledged, so the client keeps resending it until it can be applied
+		if (!ApplyInputFrame(Frame))
+			break;
+
+		AckedInputFrame = Frame.Frame;
+	}
+}
+
+bool ATankController::ApplyInputFrame(const FTankInputFrame& Frame)
+{
+	if (!CanRegisterInput())
+		return false;
+
+	bIsInAir = !TankPlayer->IsInAir();
+	Move__Internal(Frame.GetMove());
+
+	if (Frame.Turn != 0)
+		Turn__Internal(Frame.GetTurn());
+	else if (MoveValues.X != 0)
+		TurnCompleted__Internal();
+
+	return true;
 }
 
 void ATankController::UpdateTickEnable(const bool bEnable)
@@ -252,6 +330,10 @@ void ATankController::OnDie_Implementation()
 void ATankController::OnRespawn_Implementation()
 {
 	SetDefaults();
+
+	// input held through the respawn was never recorded again, send it in full for the new pawn
+	if (IsLocalController() && !HasAuthority())
+		bForceInputFrame = true;
 }
 
 void ATankController::BindControls()
@@ -293,11 +375,6 @@ bool ATankController::CanRegisterInput() const
 	return bInputMasterSwitch && bIsAlive && TankPlayer && VehicleMovementComponent && GetPawn();
 }
 
-void ATankController::MC_Move_Implementation(double Value)
-{
-	Move__Internal(Value);
-}
-
 void ATankController::Move__Internal(double Value)
 {
 	MoveValues.Y = Value;
@@ -320,12 +397,9 @@ void ATankController::Move(const FInputActionValue& Value)
 		return;
 
 	bIsInAir = !TankPlayer->IsInAir();
-	SR_Move(Value.GetMagnitude());
-}
 
-void ATankController::SR_Move_Implementation(double Value)
-{
-	MC_Move(Value);
+	// applied here straight away, the server gets it in the next input frame
+	Move__Internal(Value.GetMagnitude());
 }
 
 void ATankController::Look(const FInputActionValue& Value)
@@ -352,16 +426,6 @@ void ATankController::Turn__Internal(double Value)
 	HandleVehicleDeceleration();
 }
 
-void ATankController::MC_Turn_Implementation(const FInputActionValue& Value)
-{
-	Turn__Internal(Value.GetMagnitude());
-}
-
-void ATankController::SR_Turn_Implementation(const FInputActionValue& Value)
-{
-	MC_Turn(Value);
-}
-
 void ATankController::TurnCompleted__Internal()
 {
 	VehicleMovementComponent->SetThrottleInput(0);
@@ -372,23 +436,12 @@ void ATankController::TurnCompleted__Internal()
 	MoveValues.X = 0;
 }
 
-void ATankController::SR_TurnCompleted_Implementation(const FInputActionValue& Value)
-{
-	MC_TurnCompleted(Value);
-}
-
-void ATankController::MC_TurnCompleted_Implementation(const FInputActionValue& Value)
-{
-	TurnCompleted__Internal();
-}
-
 void ATankController::Turn(const FInputActionValue& Value)
 {
 	if (!CanRegisterInput())
 		return;
 
 	Turn__Internal(Value.GetMagnitude());
-	SR_Turn(Value);
 }
 
 void ATankController::TurnCompleted(const FInputActionValue& Value)
@@ -397,7 +450,6 @@ void ATankController::TurnCompleted(const FInputActionValue& Value)
 		return;
 	
 	TurnCompleted__Internal();
-	SR_TurnCompleted(Value);
 }
 
 void ATankController::StartShootTimer()
@@ -9,6 +9,7 @@
 #include "GameFramework/TankGameState.h"
 #include "GameFramework/TankPlayerState.h"
 #include "Kismet/GameplayStatics.h"
+#include "Libraries/TankDebugDraw.h"
 #include "Libraries/TankEnumLibrary.h"
 #include "Projectiles/ProjectilePool.h"
 
@@ -178,7 +179,7 @@ void ATanksGameMode::MC_OnPlayerDie_Implementation(APlayerState* AffectedPlayerS
 			SpawnPoint->GetActorRotation()
 		);
 
-		DrawDebugSphere(GetWorld(), SpawnPoint->GetActorLocation(), 50, 16, FColor::Emerald, true);
+		TankDebugDraw::Sphere(GetWorld(), ETankDebugDrawChannel::SpawnPoints, SpawnPoint->GetActorLocation(), 50, 16, FColor::Emerald, true);
 	}
 }
 
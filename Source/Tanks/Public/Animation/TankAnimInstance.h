@@ -6,6 +6,52 @@
 #include "VehicleAnimationInstance.h"
 #include "TankAnimInstance.generated.h"
 
+class UTankAnimInstance;
+
+/**
+ * Snapshots the tank's anim inputs on the game thread and works out the wheel, hatch, turret and gun rotations
+ * on an animation worker thread. Derives from the vehicle proxy so the wheel controller nodes keep working.
+ */
+USTRUCT()
+struct TANKS_API FTankAnimInstanceProxy : public FVehicleAnimationInstanceProxy
+{
+	GENERATED_BODY()
+
+	FTankAnimInstanceProxy(): bUpdateWheelsAndTracks(true), bUpdateHatches(true), WheelSpeed(0), TurretAngle(0), GunElevation(0),
+	                          HatchAngle(0), WheelSpeedOffset(0), WheelRotation(ForceInit), HatchRotation(ForceInit), TurretRotation(ForceInit), GunRotation(ForceInit)
+	{
+	}
+
+	FTankAnimInstanceProxy(UAnimInstance* InAnimInstance): FVehicleAnimationInstanceProxy(InAnimInstance), bUpdateWheelsAndTracks(true),
+	                                                       bUpdateHatches(true), WheelSpeed(0),
+	                                                       TurretAngle(0), GunElevation(0), HatchAngle(0), WheelSpeedOffset(0),
+	                                                       WheelRotation(ForceInit), HatchRotation(ForceInit),
+	                                                       TurretRotation(ForceInit), GunRotation(ForceInit)
+	{
+	}
+
+	/** Game thread. Copies the inputs from the anim instance. */
+	virtual void PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds) override;
+
+	/** Worker thread. Only touches the snapshot. */
+	virtual void Update(float DeltaSeconds) override;
+
+	// inputs, copied in PreUpdate
+	bool bUpdateWheelsAndTracks;
+	bool bUpdateHatches;
+	double WheelSpeed;
+	double TurretAngle;
+	double GunElevation;
+	double HatchAngle;
+
+	// outputs, copied back to the anim instance in NativeThreadSafeUpdateAnimation
+	double WheelSpeedOffset;
+	FRotator WheelRotation;
+	FRotator HatchRotation;
+	FRotator TurretRotation;
+	FRotator GunRotation;
+};
+
 /**
  * 
  */
@@ -14,40 +60,58 @@ class TANKS_API UTankAnimInstance : public UVehicleAnimationInstance
 {
 	GENERATED_BODY()
 
+	virtual FAnimInstanceProxy* CreateAnimInstanceProxy() override;
+	virtual void DestroyAnimInstanceProxy(FAnimInstanceProxy* InProxy) override;
+
+	virtual void NativeInitializeAnimation() override;
 	virtual void NativeUpdateAnimation(float DeltaSeconds) override;
-	virtual void GetLifetimeReplicatedProps(TArray<class FLifetimeProperty>& OutLifetimeProps) const override;
+
+	/** Copies the rotations the proxy worked out into the properties the anim graph reads. Runs on a worker thread if the anim BP allows it. */
+	virtual void NativeThreadSafeUpdateAnimation(float DeltaSeconds) override;
 
 public:
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup", Replicated)
+	/**
+	 * The anim instance is not replicated. WheelSpeed, TurretAngle, GunElevation and HatchAngle are set
+	 * on every machine by the owning ATankCharacter and the rotations below are worked out from them locally.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup")
 	double WheelSpeed;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup")
 	double WheelSpeedOffset;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup", Replicated)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup")
 	double TurretAngle;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup", Replicated)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup")
 	double GunElevation;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup", Replicated)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Setup")
 	double HatchAngle;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Replicated)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator WheelRotation;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Replicated)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator HatchRotation;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Replicated)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator TurretRotation;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Replicated)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator GunRotation;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TObjectPtr<UMaterialInstanceDynamic> TracksMID;
 
+	/** Turned off by UTankSignificanceSubsystem while the tank is offscreen. The wheels stop turning and the tracks material is not updated. */
+	UPROPERTY(BlueprintReadOnly)
+	bool bUpdateWheelsAndTracks = true;
+
+	/** Turned off by UTankSignificanceSubsystem for tanks that are too far away for their hatches to be seen moving */
+	UPROPERTY(BlueprintReadOnly)
+	bool bUpdateHatches = true;
+
 	UFUNCTION(BlueprintCallable)
 	void UpdateSpeedOffset(const double Increment);
 	
@@ -60,42 +124,13 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void UpdateTurret();
 
+	/** Writes material parameters, so it is always called on the game thread */
 	UFUNCTION(BlueprintCallable, BlueprintImplementableEvent)
 	void UpdateTracksMaterial();
-	
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_UpdateWheels();
-	
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_UpdateHatches();
-
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_UpdateTurret();
-
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_UpdateTracksMaterial();
-
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_UpdateWheels();
-	
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_UpdateHatches();
-
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_UpdateTurret();
-
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_UpdateTracksMaterial();
 
 	UFUNCTION(BlueprintCallable)
 	void SetTracksMID(UMaterialInstanceDynamic* MID) { this->TracksMID = MID; }
 
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_SetGunElevation(const double NewGunElevation);
-
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_SetGunElevation(const double NewGunElevation);
-
 	UFUNCTION(BlueprintCallable, BlueprintPure)
 	double GetGunElevation() { return GunElevation; }
 
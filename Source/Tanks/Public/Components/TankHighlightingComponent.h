@@ -22,7 +22,6 @@ class TANKS_API UTankHighlightingComponent : public UActorComponent
 	FTimerHandle TimerHandle;
 	
 	UTankHighlightingComponent();
-	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
 public:
 	/** The Z offset of the "+" trace */
@@ -48,16 +47,14 @@ public:
 
 private:
 	UPROPERTY(meta=(AllowPrivateAccess="true"))
-	TArray<FHitResult> HighlightedEnemyTanks;
-	
-	UPROPERTY(meta=(AllowPrivateAccess="true"))
-	TArray<FHitResult> CurrentHitResults;
+	TArray<TObjectPtr<ATankCharacter>> HighlightedEnemyTanks;
 
-	UPROPERTY(meta=(AllowPrivateAccess="true"))
-	TArray<FHitResult> VerticalHits;
+	/** Friendly tanks that were outlined by the last HighlightFriendlyTanks */
+	TArray<TWeakObjectPtr<ATankCharacter>> HighlightedFriendlyTanks;
 
-	UPROPERTY(meta=(AllowPrivateAccess="true"))
-	TArray<FHitResult> HorizontalHits;
+	/** Scratch for the tanks found this time, kept to avoid reallocating */
+	TArray<ATankCharacter*> CurrentTanks;
+	TArray<ATankCharacter*> VerticalTanks;
 
 protected:
 	// Called when the game starts
@@ -66,16 +63,18 @@ protected:
 	/**
 	 * Runs every 5 seconds via timer. Checks the distances between every friendly tank
 	 * and if it's farther than a certain threshold, remove the highlights to save performance.
+	 * Friendly tanks come from UTankSpatialHashSubsystem. OutlineTank is only called for tanks that changed.
 	 */
 	UFUNCTION(BlueprintCallable)
 	void HighlightFriendlyTanks();
 
-	/** Creates two box traces that combine to create a "+" sign attached to the gun turret. */
+public:
+	/** Finds the tanks in two boxes that combine to create a "+" sign along the gun turret, with UTankSpatialHashSubsystem.
+	 * Called by ATankCharacter at the rate of its Highlighting tick task. OutlineTank is only called for tanks that changed. */
 	UFUNCTION(BlueprintNativeEvent)
 	void HighlightEnemyTanksIfDetected();
 
-public:
 	void SetDefaults();
 
-	const TArray<FHitResult>& GetHighlightedEnemyTanks() const { return HighlightedEnemyTanks; }
+	const TArray<TObjectPtr<ATankCharacter>>& GetHighlightedEnemyTanks() const { return HighlightedEnemyTanks; }
 };
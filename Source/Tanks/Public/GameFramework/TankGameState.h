@@ -19,7 +19,6 @@ class TANKS_API ATankGameState : public AGameState
 
 	void SpawnProjectilePool();
 	void RemoveAllProjectilePools() const;
-	virtual void OnConstruction(const FTransform& Transform) override;
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 	virtual void BeginPlay() override;
 
@@ -0,0 +1,102 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Libraries/TankEnumLibrary.h"
+#include "TankTickSettings.generated.h"
+
+DECLARE_STATS_GROUP(TEXT("TankTick"), STATGROUP_TankTick, STATCAT_Advanced);
+
+/**
+ * The tick tier of every ETankTickTask for one role.
+ */
+USTRUCT(BlueprintType)
+struct FTankTickTiers
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier CameraTrace;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier TurretTrace;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier TurretTurning;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier GunElevation;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier BarrelClearance;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier CameraPitchLimits;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier ConeTrace;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier AimAssist;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier GunSight;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Tick")
+	ETankTickTier Highlighting;
+
+	FTankTickTiers() : CameraTrace(ETankTickTier::EveryFrame), TurretTrace(ETankTickTier::EveryFrame),
+	                   TurretTurning(ETankTickTier::EveryFrame), GunElevation(ETankTickTier::EveryFrame),
+	                   BarrelClearance(ETankTickTier::EveryFrame), CameraPitchLimits(ETankTickTier::EveryFrame),
+	                   ConeTrace(ETankTickTier::EveryFrame), AimAssist(ETankTickTier::EveryFrame),
+	                   GunSight(ETankTickTier::EveryFrame), Highlighting(ETankTickTier::EveryFrame)
+	{
+	}
+
+	ETankTickTier GetTier(ETankTickTask Task) const;
+};
+
+/**
+ * Scheduling state of one tick task on a tank.
+ */
+struct FTankTickTaskState
+{
+	ETankTickTier Tier = ETankTickTier::EveryFrame;
+
+	/** Time since the task last ran */
+	float Time = 0;
+
+	/** Set by ATankCharacter::RequestTickTask, runs the task on the next tick whatever its tier is */
+	bool bRequested = false;
+
+	/** The task's async traces were requested on PrefetchFrame, it runs on the next frame to read them */
+	bool bPrefetched = false;
+	uint64 PrefetchFrame = 0;
+};
+
+/**
+ * How often each part of ATankCharacter::Tick runs, read from the [/Script/Tanks.TankTickSettings] section of the game ini.
+ * Platforms can override it in Config/<Platform>/<Platform>Game.ini.
+ */
+UCLASS(Config=Game)
+class TANKS_API UTankTickSettings : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UTankTickSettings();
+
+	/** Tiers of the tank the player is controlling, on a client or a listen server host */
+	UPROPERTY(Config, EditAnywhere, Category = "Tick")
+	FTankTickTiers ClientTiers;
+
+	/** Tiers of a remote player's tank on the server */
+	UPROPERTY(Config, EditAnywhere, Category = "Tick")
+	FTankTickTiers ServerTiers;
+
+	const FTankTickTiers& GetTiers(bool bLocallyControlled) const { return bLocallyControlled ? ClientTiers : ServerTiers; }
+
+	/** Seconds between two runs of a task in this tier. 0 for every frame and on event. */
+	static float GetTierInterval(ETankTickTier Tier);
+};
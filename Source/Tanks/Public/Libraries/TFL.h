@@ -3,10 +3,35 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "WorldCollision.h"
 #include "Kismet/BlueprintFunctionLibrary.h"
 #include "TFL.generated.h"
 
 class ATankCharacter;
+
+/**
+ * A cone query submitted with UTFL::RequestConeOverlapVehiclesAsync. Read it back on the next frame.
+ */
+struct FConeQueryHandle
+{
+	FTraceHandle AxisTrace;
+
+	FVector Origin;
+	FVector Direction;
+	float Length;
+	float StartRadius;
+	float EndRadius;
+
+	/** Left out of the vehicles once the query is read back */
+	TArray<TWeakObjectPtr<AActor>, TInlineAllocator<2>> IgnoreActors;
+
+	FConeQueryHandle(): Origin(ForceInit), Direction(ForceInit), Length(0), StartRadius(0), EndRadius(0)
+	{
+	}
+
+	bool IsValid() const { return AxisTrace.IsValid(); }
+};
+
 /**
  * 
  */
@@ -16,8 +41,33 @@ class TANKS_API UTFL : public UBlueprintFunctionLibrary
 	GENERATED_BODY()
 
 public:
+	/**
+	  * Finds every tank inside a cone with one scene query instead of one sphere trace per step.
+	  * A line trace along the axis shortens the cone at the first non-vehicle blocker, then the tanks are
+	  * taken from UTankSpatialHashSubsystem and tested against the cone analytically.
+	  * @param Origin - Tip of the cone
+	  * @param Direction - Axis of the cone, normalized
+	  * @param Length - Length of the cone
+	  * @param StartRadius - Radius at the origin
+	  * @param EndRadius - Radius at the end
+	  * @param IgnoreActors - List of Actors to ignore
+	  * @param OutVehicles - Every vehicle inside the cone, each only once
+	  * @return The length of the cone after it was shortened by a blocker
+	 */
+	static float ConeOverlapVehicles(const UObject* WorldContextObject, const FVector& Origin, const FVector& Direction, float Length, float StartRadius, float EndRadius, const TArray<AActor*>& IgnoreActors, TArray<AActor*>& OutVehicles);
+
+	/** Same as ConeOverlapVehicles, but the axis trace runs on the physics thread. Results are ready on the next frame. */
+	static FConeQueryHandle RequestConeOverlapVehiclesAsync(const UObject* WorldContextObject, const FVector& Origin, const FVector& Direction, float Length, float StartRadius, float EndRadius, const TArray<AActor*>& IgnoreActors);
+
+	/**
+	  * Reads back a query from RequestConeOverlapVehiclesAsync. The handle is cleared once the result was read, or if it expired.
+	  * @param OutLength - The length of the cone after it was shortened by a blocker
+	  * @return false if the result is not ready
+	 */
+	static bool ConsumeConeOverlapVehicles(const UObject* WorldContextObject, FConeQueryHandle& Handle, TArray<AActor*>& OutVehicles, float& OutLength);
+
 	/** Ripped from UGameplayStatics::ApplyRadialDamageWithFalloff and modified it.
-	  * Hurt locally authoritative actors within the radius. Will only hit components that block the Visibility channel.
+	  * Hurt locally authoritative tanks within the radius, found with UTankSpatialHashSubsystem instead of an overlap of every dynamic object.
 	  * @param BaseDamage - The base damage to apply, i.e. the damage at the origin.
 	  * @param MinimumDamage - The minimum damage
 	  * @param Origin - Epicenter of the damage area.
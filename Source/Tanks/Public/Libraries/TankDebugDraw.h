@@ -0,0 +1,65 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/KismetSystemLibrary.h"
+
+/** Debug drawing is compiled out of Shipping and dedicated server builds. */
+#define TANK_DEBUG_DRAW (ENABLE_DRAW_DEBUG && !UE_BUILD_SHIPPING && !UE_SERVER)
+
+/**
+ * Categories of debug drawing. Each one is toggled with its own console variable, e.g. "tank.Debug.Projectiles 1".
+ */
+enum class ETankDebugDrawChannel : uint8
+{
+	Projectiles,
+	Targeting,
+	ConeTrace,
+	SpawnPoints,
+	TurretTraces,
+	Significance,
+	GunElevation,
+
+	Num
+};
+
+/**
+ * Channel-gated debug drawing. Lines are collected over the frame and handed to the world's line batcher in one call.
+ * Everything here is an empty inline function when TANK_DEBUG_DRAW is 0.
+ */
+namespace TankDebugDraw
+{
+#if TANK_DEBUG_DRAW
+	TANKS_API bool IsChannelEnabled(ETankDebugDrawChannel Channel);
+
+	TANKS_API void Sphere(const UWorld* World, ETankDebugDrawChannel Channel, const FVector& Center, float Radius,
+	                      int32 Segments, const FColor& Color, bool bPersistent = false);
+
+	TANKS_API void Line(const UWorld* World, ETankDebugDrawChannel Channel, const FVector& Start, const FVector& End,
+	                    const FColor& Color, bool bPersistent = false);
+
+	/** Text in the world, drawn for Duration seconds */
+	TANKS_API void String(const UWorld* World, ETankDebugDrawChannel Channel, const FVector& Location, const FString& Text,
+	                      const FColor& Color, float Duration);
+
+	/** Returns Requested if the channel is on, so it can be passed straight to UKismetSystemLibrary traces */
+	TANKS_API EDrawDebugTrace::Type TraceType(ETankDebugDrawChannel Channel, EDrawDebugTrace::Type Requested);
+#else
+	inline bool IsChannelEnabled(ETankDebugDrawChannel) { return false; }
+
+	inline void Sphere(const UWorld*, ETankDebugDrawChannel, const FVector&, float, int32, const FColor&, bool = false)
+	{
+	}
+
+	inline void Line(const UWorld*, ETankDebugDrawChannel, const FVector&, const FVector&, const FColor&, bool = false)
+	{
+	}
+
+	inline void String(const UWorld*, ETankDebugDrawChannel, const FVector&, const FString&, const FColor&, float)
+	{
+	}
+
+	inline EDrawDebugTrace::Type TraceType(ETankDebugDrawChannel, EDrawDebugTrace::Type) { return EDrawDebugTrace::None; }
+#endif
+}
@@ -10,6 +10,68 @@ enum class ETeam : uint8
 	NoTeam UMETA(DisplayName = "NoTeam"),
 };
 
+/**
+ * How a shot is resolved when the tank fires.
+ */
+UENUM(BlueprintType)
+enum class ETankBallisticsMode : uint8
+{
+	/** Hitscan if the shell would reach the target within HitscanTimeThreshold, projectile otherwise */
+	Auto UMETA(DisplayName = "Auto"),
+	/** Every shot that hits within the turret trace is hitscan */
+	Hitscan UMETA(DisplayName = "Hitscan"),
+	/** Every shot is a simulated projectile from the muzzle */
+	Projectile UMETA(DisplayName = "Projectile"),
+};
+
+/**
+ * How often a tank tick task runs. See UTankTickSettings.
+ */
+UENUM(BlueprintType)
+enum class ETankTickTier : uint8
+{
+	EveryFrame UMETA(DisplayName = "Every Frame"),
+	Hz30 UMETA(DisplayName = "30 Hz"),
+	Hz10 UMETA(DisplayName = "10 Hz"),
+	/** Only runs when requested with ATankCharacter::RequestTickTask */
+	OnEvent UMETA(DisplayName = "On Event"),
+};
+
+/**
+ * The work ATankCharacter does every tick, each of them gets its own ETankTickTier.
+ */
+UENUM(BlueprintType)
+enum class ETankTickTask : uint8
+{
+	CameraTrace,
+	TurretTrace,
+	TurretTurning,
+	GunElevation,
+	BarrelClearance,
+	CameraPitchLimits,
+	ConeTrace,
+	AimAssist,
+	GunSight,
+	Highlighting,
+
+	Num UMETA(Hidden)
+};
+
+/**
+ * How much a tank matters to the local player, worked out by UTankSignificanceSubsystem.
+ */
+UENUM(BlueprintType)
+enum class ETankSignificance : uint8
+{
+	/** The tank this player controls */
+	Local UMETA(DisplayName = "Local"),
+	High UMETA(DisplayName = "High"),
+	Medium UMETA(DisplayName = "Medium"),
+	Low UMETA(DisplayName = "Low"),
+	/** Not rendered recently */
+	Offscreen UMETA(DisplayName = "Offscreen"),
+};
+
 /**
  * Creates an array with every single possible value of its corresponding enum.
  */
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "UObject/Object.h"
+#include "Engine/NetSerialization.h"
 #include "Libraries/TankEnumLibrary.h"
 #include "TankStructLibrary.generated.h"
 
@@ -25,3 +26,114 @@ struct FTeamData
 	{
 	}
 };
+
+/**
+ * Turret yaw and gun pitch of a tank, each compressed to 16 bits (about 0.0055 degrees per step).
+ */
+USTRUCT(BlueprintType)
+struct FTankAimState
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	uint16 TurretYaw;
+
+	UPROPERTY()
+	uint16 GunPitch;
+
+	FTankAimState(): TurretYaw(0), GunPitch(0)
+	{
+	}
+
+	void Set(const double TurretAngle, const double GunElevation)
+	{
+		TurretYaw = FRotator::CompressAxisToShort(TurretAngle);
+		GunPitch = FRotator::CompressAxisToShort(GunElevation);
+	}
+
+	/** In degrees, from -180 to 180 */
+	double GetTurretAngle() const { return FRotator::NormalizeAxis(FRotator::DecompressAxisFromShort(TurretYaw)); }
+
+	/** In degrees, from -180 to 180 */
+	double GetGunElevation() const { return FRotator::NormalizeAxis(FRotator::DecompressAxisFromShort(GunPitch)); }
+
+	bool operator==(const FTankAimState& Other) const { return TurretYaw == Other.TurretYaw && GunPitch == Other.GunPitch; }
+	bool operator!=(const FTankAimState& Other) const { return !(*this == Other); }
+};
+
+/**
+ * The move and turn input of one input frame, sent from the owning client to the server. 4 bytes.
+ */
+USTRUCT()
+struct FTankInputFrame
+{
+	GENERATED_BODY()
+
+	/** Wraps around, compare with IsNewerThan */
+	UPROPERTY()
+	uint16 Frame;
+
+	/** -1 to 1 quantised to -127 to 127 */
+	UPROPERTY()
+	int8 Move;
+
+	UPROPERTY()
+	int8 Turn;
+
+	FTankInputFrame(): Frame(0), Move(0), Turn(0)
+	{
+	}
+
+	FTankInputFrame(const uint16 InFrame, const double InMove, const double InTurn):
+		Frame(InFrame),
+		Move(static_cast<int8>(FMath::RoundToInt(FMath::Clamp(InMove, -1.0, 1.0) * 127.0))),
+		Turn(static_cast<int8>(FMath::RoundToInt(FMath::Clamp(InTurn, -1.0, 1.0) * 127.0)))
+	{
+	}
+
+	double GetMove() const { return Move / 127.0; }
+	double GetTurn() const { return Turn / 127.0; }
+
+	bool HasSameInput(const FTankInputFrame& Other) const { return Move == Other.Move && Turn == Other.Turn; }
+
+	static bool IsNewerThan(const uint16 A, const uint16 B) { return static_cast<int16>(A - B) > 0; }
+};
+
+/**
+ * Everything another machine needs to fly its own copy of a shell. Sent once per shot instead of replicating the projectile.
+ * The server decides what the shell hit and confirms it by ShotId, see ATankCharacter::MC_ConfirmShotHit.
+ */
+USTRUCT(BlueprintType)
+struct FProjectileSpawnParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	FVector_NetQuantize Origin;
+
+	/** Normalized */
+	UPROPERTY(BlueprintReadOnly)
+	FVector_NetQuantizeNormal Direction;
+
+	/** cm/s, only used by shells simulated by UTankBallisticsSubsystem */
+	UPROPERTY(BlueprintReadOnly)
+	float Speed;
+
+	/** Server time the shell was fired at. Machines that get it later catch the shell up by the difference. */
+	UPROPERTY(BlueprintReadOnly)
+	double ServerTime;
+
+	/** Counts up per tank and wraps around. Only unique among the shells one tank has in flight. */
+	UPROPERTY()
+	uint16 ShotId;
+
+	FProjectileSpawnParams(): Origin(ForceInitToZero), Direction(ForceInitToZero), Speed(0), ServerTime(0), ShotId(0)
+	{
+	}
+
+	FProjectileSpawnParams(const FVector& InOrigin, const FVector& InDirection, const float InSpeed, const double InServerTime,
+	                       const uint16 InShotId):
+		Origin(InOrigin), Direction(InDirection.GetSafeNormal()), Speed(InSpeed), ServerTime(InServerTime), ShotId(InShotId)
+	{
+	}
+};
@@ -4,13 +4,59 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Libraries/TankStructLibrary.h"
 #include "ProjectilePool.generated.h"
 
 class ATankProjectile;
 
+/**
+ * Counters used to size the pool per map from real match data.
+ * Logged when the pool ends play and visible with "stat ProjectilePool".
+ */
+USTRUCT(BlueprintType)
+struct FProjectilePoolStats
+{
+	GENERATED_BODY()
+
+	/** The most projectiles that were in use at the same time */
+	UPROPERTY(BlueprintReadOnly, Category="Projectile Pool")
+	int32 HighWater;
+
+	/** How many shots were requested while the pool had no free projectile */
+	UPROPERTY(BlueprintReadOnly, Category="Projectile Pool")
+	int32 Misses;
+
+	/** How many times a growth chunk was scheduled */
+	UPROPERTY(BlueprintReadOnly, Category="Projectile Pool")
+	int32 Grows;
+
+	/** How many idle projectiles were destroyed by trimming */
+	UPROPERTY(BlueprintReadOnly, Category="Projectile Pool")
+	int32 Trimmed;
+
+	FProjectilePoolStats(): HighWater(0), Misses(0), Grows(0), Trimmed(0)
+	{
+	}
+};
+
+/**
+ * An entry in AProjectilePool's expiry heap. Stale once the slot's generation has moved on.
+ */
+struct FProjectileExpiry
+{
+	double ExpireTime;
+	int32 PoolIndex;
+	uint32 Generation;
+
+	bool operator<(const FProjectileExpiry& Other) const { return ExpireTime < Other.ExpireTime; }
+};
+
 /**
  *  Static Projectile Pool. Handles the spawning and "deletion" of projectiles.
  *  Note: If manually placed in a level, it will be deleted and another will be created.
+ *  The pool warms up over several ticks after BeginPlay, see InitPool.
+ *  Every machine has its own pool. Neither the pool nor its projectiles replicate, shots are sent
+ *  as FProjectileSpawnParams and each machine flies its own copy, see SpawnFromParams.
  */
 UCLASS(Abstract)
 class TANKS_API AProjectilePool : public AActor
@@ -20,21 +66,127 @@ class TANKS_API AProjectilePool : public AActor
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool", meta = (AllowPrivateAccess = "true"))
 	TSubclassOf<ATankProjectile> ProjectileClass;
 
-	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool", meta = (AllowPrivateAccess = "true"))
+	/** How many projectiles are created during warm-up. The pool never trims below this size. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool", meta = (AllowPrivateAccess = "true", ClampMin = 1))
 	int PoolSize;
 
+	/** Upper limit of projectiles spawned per tick while warming up. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Warm Up", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	int32 WarmUpSpawnsPerTick;
+
+	/** Warm-up stops spawning for the current frame once this many milliseconds have been spent. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Warm Up", meta = (AllowPrivateAccess = "true", ClampMin = 0.1, Units = "Milliseconds"))
+	float WarmUpBudgetMs;
+
+	/**
+	 * Fire shells through UTankBallisticsSubsystem instead of pooled actors. No actors are spawned and
+	 * SpawnFromPool returns null, the callback object still gets IShootingInterface::ProjectileHit.
+	 */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Ballistics", meta = (AllowPrivateAccess = "true"))
+	bool bUseBallisticsSubsystem;
+
+	/** Shells fired on another machine are caught up by at most this long, anything older is shown late instead. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Network", meta = (AllowPrivateAccess = "true", ClampMin = 0, Units = "Seconds"))
+	float MaxFastForwardTime;
+
+	/** The pool will never grow past this many projectiles. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Growth", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	int32 MaxPoolSize;
+
+	/** How many projectiles are added each time the pool grows. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Growth", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	int32 GrowthChunkSize;
+
+	/** When this fraction of the pool is in use, another chunk is scheduled. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Growth", meta = (AllowPrivateAccess = "true", ClampMin = 0.1, ClampMax = 1))
+	float GrowthHighWaterRatio;
+
+	/** Scheduled projectiles are spawned at most this many per frame so growing never hitches. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Growth", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	int32 MaxSpawnsPerFrame;
+
+	/** If the pool is completely dry, spawn one projectile immediately instead of losing the shot. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Growth", meta = (AllowPrivateAccess = "true"))
+	bool bSpawnOnMiss;
+
+	/** How long usage has to stay under TrimLowWaterRatio before idle projectiles are destroyed. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Trimming", meta = (AllowPrivateAccess = "true", ClampMin = 0))
+	float TrimCooldown;
+
+	/** Usage below this fraction of the pool counts as idle for trimming. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Trimming", meta = (AllowPrivateAccess = "true", ClampMin = 0, ClampMax = 1))
+	float TrimLowWaterRatio;
+
+	/** Idle projectiles are destroyed at most this many per frame. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Projectile Pool|Trimming", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	int32 MaxTrimsPerFrame;
+
+	/** Can contain null entries for slots freed by trimming. Those are reused when the pool grows. */
 	UPROPERTY(BlueprintReadOnly, Category="Projectile Pool", meta = (AllowPrivateAccess = "true"))
 	TArray<TObjectPtr<ATankProjectile>> PooledActors;
 
+	UPROPERTY(BlueprintReadOnly, Category="Projectile Pool", meta = (AllowPrivateAccess = "true"))
+	FProjectilePoolStats Stats;
+
+	/** Stack of indices into PooledActors that are not in use. Popped on spawn, pushed back on deactivate. */
+	TArray<int32> FreeIndices;
+
+	/** Indices into PooledActors that were trimmed and are null. */
+	TArray<int32> EmptySlots;
+
+	/** Bumped every time the projectile in a slot is activated. Same size as PooledActors. */
+	TArray<uint32> SlotGenerations;
+
+	/** Min-heap of when active projectiles run out of TimeToLive. Checked once per tick. */
+	TArray<FProjectileExpiry> ExpiryHeap;
+
+	/** Projectiles scheduled to be spawned over the next frames. */
+	int32 PendingSpawns;
+
+	/** Last time usage was above TrimLowWaterRatio. */
+	double LastBusyTime;
+
+	/** Projectiles left to spawn before warm-up is complete. */
+	int32 WarmUpRemaining;
+
+	/** Number of frames warm-up has run for. */
+	int32 WarmUpFrames;
+
+	/** Time actually spent spawning during warm-up, in seconds. */
+	double WarmUpSpawnTime;
+
+	/** FPlatformTime::Seconds() when warm-up started. */
+	double WarmUpStartTime;
+
 	// Sets default values for this actor's properties
 	AProjectilePool();
 	virtual ~AProjectilePool() override;
 
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
+	/** Starts the time-sliced warm-up. Projectiles are created in ProcessWarmUp over the next ticks. */
 	void InitPool();
 
+	/** Spawns warm-up projectiles until WarmUpSpawnsPerTick or WarmUpBudgetMs is reached. */
+	void ProcessWarmUp();
+
+	/** Spawns a single projectile, puts it in an empty slot (or at the end) and adds it to the free list. */
+	ATankProjectile* SpawnPooledProjectile();
+
+	/** Schedules GrowthChunkSize projectiles to be spawned over the next frames. */
+	void RequestGrowth();
+
+	void ProcessPendingSpawns();
+	void TrimIdleProjectiles();
+
+	/** Deactivates every projectile whose TimeToLive has run out. */
+	void ExpireProjectiles();
+
+	/** Pops the top of the free list. The projectile must be the one returned by FindFirstAvailableProjectile. */
+	void AcquireFromFreeList(const ATankProjectile* Projectile);
+
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 	
@@ -45,10 +197,48 @@ public:
 	/**
 	 * @param SpawnTransform Where the object should "spawn"
 	 * @param Object To provide a callback function when the projectile hits something
-	 * @param InitialSpeed The initial speed of the projectile. currently does not do anything.
-	 * @return Returns the projectile actor that was just spawned.
+	 * @param InitialSpeed The initial speed of the projectile. used by pooled actors and by bUseBallisticsSubsystem alike.
+	 * @return Returns the projectile actor that was just spawned. null if bUseBallisticsSubsystem is set.
 	 */
 	UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
 	ATankProjectile* SpawnFromPool(const FTransform& SpawnTransform, UObject* Object = nullptr,
 	                               const double InitialSpeed = 50000.0);
+
+	/**
+	 * Spawns a shell fired on this or another machine and catches it up by the time since Params.ServerTime.
+	 * @param Params Where, where to and when the shell was fired
+	 * @param Object To provide a callback function when the projectile hits something
+	 * @return The projectile actor that was just spawned. null if bUseBallisticsSubsystem is set.
+	 */
+	UFUNCTION(BlueprintCallable, Category="Projectile Pool")
+	ATankProjectile* SpawnFromParams(const FProjectileSpawnParams& Params, UObject* Object = nullptr);
+
+	/**
+	 * Ends a shell that is still in flight at the server's confirmed hit location and spawns its hit effect.
+	 * @param Object The callback object the shell was spawned with
+	 * @param ShotId FProjectileSpawnParams::ShotId
+	 * @return false if the shell already hit something or expired
+	 */
+	bool StopShot(const UObject* Object, uint16 ShotId, const FVector& Location);
+
+	/** Same clock as FProjectileSpawnParams::ServerTime */
+	double GetServerTime() const;
+
+	/** Called by ATankProjectile::Deactivate. Pushes the projectile back onto the free list. */
+	void ReturnToPool(ATankProjectile* Projectile);
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Projectile Pool")
+	int32 GetNumAvailable() const { return FreeIndices.Num(); }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Projectile Pool")
+	int32 GetNumInUse() const { return GetNumPooled() - FreeIndices.Num(); }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Projectile Pool")
+	int32 GetNumPooled() const { return PooledActors.Num() - EmptySlots.Num(); }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Projectile Pool")
+	const FProjectilePoolStats& GetStats() const { return Stats; }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Projectile Pool")
+	bool IsWarmingUp() const { return WarmUpRemaining > 0; }
 };
@@ -25,8 +25,8 @@ class TANKS_API IShootingInterface
 public:
 	/**
 	 * This is supposed to be used as a callback function when a projectile you spawned hits something. NOT when a projectile hits you. 
-	 * @param TankProjectile The projectile you spawned 
-	 * @param HitComponent The hit component of the projectile
+	 * @param TankProjectile The projectile you spawned. null for shells simulated by UTankBallisticsSubsystem
+	 * @param HitComponent The hit component of the projectile. null for shells simulated by UTankBallisticsSubsystem
 	 * @param OtherActor The hit actor
 	 * @param OtherComp The hit component
 	 * @param NormalImpulse The normal impusle
@@ -35,4 +35,11 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
 	void ProjectileHit(ATankProjectile* TankProjectile, UPrimitiveComponent* HitComponent, AActor* OtherActor,
 			UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
+
+	/**
+	 * C++ only. Called right after ProjectileHit, for actor and subsystem shells alike.
+	 * @param ShotId FProjectileSpawnParams::ShotId of the shell that hit
+	 * @param Hit The hitresult
+	 */
+	virtual void ShotHit(uint16 ShotId, const FHitResult& Hit) {}
 };
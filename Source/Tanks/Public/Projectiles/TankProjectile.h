@@ -38,10 +38,6 @@ class TANKS_API ATankProjectile : public AActor
 {
 	GENERATED_BODY()
 
-	/* Please add a variable description */
-	UPROPERTY(BlueprintReadOnly, meta=(AllowPrivateAccess="true"))
-	FTimerHandle TimerHandle;
-
 	/* Please add a variable description */
 	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly, meta=(AllowPrivateAccess="true"))
 	TObjectPtr<USphereComponent> SphereCollision;
@@ -78,7 +74,7 @@ class TANKS_API ATankProjectile : public AActor
 	UPROPERTY(BlueprintReadOnly, meta=(AllowPrivateAccess="true"), Category="Setup|Projectile Pool")
 	bool bIsInUse;
 
-	/* if a projectile has not hit anything after this time has passed, it will deactivate on its own. */
+	/* if a projectile has not hit anything after this time has passed, the pool deactivates it. */
 	UPROPERTY(BlueprintReadOnly, meta=(AllowPrivateAccess="true"), Category="Setup|Projectile Pool")
 	double TimeToLive;
 	
@@ -86,6 +82,13 @@ class TANKS_API ATankProjectile : public AActor
 	UPROPERTY(BlueprintReadOnly, meta=(AllowPrivateAccess="true"), Category="Setup|Static/Skeletal Mesh")
 	TObjectPtr<AProjectilePool> ProjectilePool;
 
+	/* Index of this projectile in the pool's PooledActors array. Set when spawned */
+	UPROPERTY(BlueprintReadOnly, meta=(AllowPrivateAccess="true"), Category="Setup|Projectile Pool")
+	int32 PoolIndex;
+
+	/* FProjectileSpawnParams::ShotId of the shot this projectile is flying for */
+	uint16 ShotId;
+
 	/* Please add a variable description */
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, meta=(AllowPrivateAccess="true"), Category="Setup|Static/Skeletal Mesh")
 	bool bUseSkeletalMesh;
@@ -124,13 +127,11 @@ class TANKS_API ATankProjectile : public AActor
 	UFUNCTION()
 	void OnSphereComponentHit(UPrimitiveComponent* HitComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
 	ATankProjectile();
-	virtual ~ATankProjectile() override;
 	void ApplyRadialImpulseToObjects(const FHitResult& Hit);
 	void CreateMesh();
 	void SetMeshAssets();
 	virtual void BeginPlay() override;
 	virtual void OnConstruction(const FTransform& Transform) override;
-	virtual void Tick(float DeltaSeconds) override;
 
 public:
 	UFUNCTION(BlueprintCallable)
@@ -141,6 +142,12 @@ public:
 
 	UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
 	void Deactivate();
+
+	/** Moves an active projectile to where it would be Time seconds after Activate. Swept, so it still hits anything on the way. */
+	void FastForward(float Time);
+
+	/** Ends the flight at the server's confirmed hit location without a ProjectileHit callback */
+	void StopAt(const FVector& Location);
 	
 	UFUNCTION(BlueprintCallable, BlueprintPure)
 	UStaticMeshComponent* GetStaticMeshComponent() const { return StaticMeshComponent; }
@@ -169,11 +176,30 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintPure)
 	USphereComponent* GetSphereCollision() const { return SphereCollision; }
 
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+	UProjectileMovementComponent* GetProjectileMovementComponent() const { return ProjectileMovementComponent; }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+	UStaticMesh* GetStaticMesh() const { return StaticMesh; }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+	double GetTimeToLive() const { return TimeToLive; }
+
 	UFUNCTION(BlueprintCallable, BlueprintPure)
 	AProjectilePool* GetProjectilePool() const { return ProjectilePool; }
 
 	UFUNCTION(BlueprintCallable)
 	void SetProjectilePool(AProjectilePool* NewProjectilePool) { this->ProjectilePool = NewProjectilePool; }
 
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+	int32 GetPoolIndex() const { return PoolIndex; }
+
+	void SetPoolIndex(const int32 NewPoolIndex) { this->PoolIndex = NewPoolIndex; }
+
 	void SetCallbackObject(UObject* NewCallbackObject) { this->CallbackObject = NewCallbackObject; }
+
+	UObject* GetCallbackObject() const { return CallbackObject; }
+
+	uint16 GetShotId() const { return ShotId; }
+	void SetShotId(const uint16 NewShotId) { this->ShotId = NewShotId; }
 };
@@ -0,0 +1,130 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TankBallisticsSubsystem.generated.h"
+
+class ATankProjectile;
+class UInstancedStaticMeshComponent;
+
+/**
+ * A single shell in flight. Plain data, no actor or components.
+ */
+struct FTankShell
+{
+	FVector Location;
+	FVector Velocity;
+
+	/** World time at which the shell is dropped if it has not hit anything */
+	double ExpireTime;
+
+	/** Added to the shell's first step, for shells fired on another machine a while ago */
+	float CatchUpTime;
+
+	/** Index into UTankBallisticsSubsystem::ShellTypes */
+	int32 TypeIndex;
+
+	/** Gets IShootingInterface::ProjectileHit when the shell hits something */
+	TWeakObjectPtr<UObject> CallbackObject;
+
+	/** Ignored by the sweep, usually the tank that fired */
+	TWeakObjectPtr<AActor> IgnoredActor;
+
+	/** FProjectileSpawnParams::ShotId, passed to IShootingInterface::ShotHit */
+	uint16 ShotId;
+};
+
+/**
+ * Settings shared by every shell fired from the same projectile class. Read once from the class default object.
+ */
+USTRUCT()
+struct FTankShellType
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TSubclassOf<ATankProjectile> ProjectileClass;
+
+	/** Only created on machines that render */
+	UPROPERTY()
+	TObjectPtr<UInstancedStaticMeshComponent> Visuals;
+
+	float Radius;
+	float GravityScale;
+	double TimeToLive;
+
+	/** Scratch buffer for the batched instance update */
+	TArray<FTransform> InstanceTransforms;
+
+	FTankShellType(): Radius(0), GravityScale(0), TimeToLive(0)
+	{
+	}
+};
+
+/**
+ * Simulates shells as structs in one contiguous array instead of one ATankProjectile actor each.
+ * All shells are advanced in a single batched update with one sweep per shell per tick, so hundreds of
+ * shells can be in flight on the server without per-actor tick or component transform costs.
+ * Visuals are drawn with one instanced static mesh per projectile class, hit effects use the projectile class' settings.
+ * The callback object gets IShootingInterface::ProjectileHit with a null TankProjectile.
+ */
+UCLASS()
+class TANKS_API UTankBallisticsSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FTankShellType> ShellTypes;
+
+	/** Owns the instanced mesh components */
+	UPROPERTY()
+	TObjectPtr<AActor> VisualsActor;
+
+	TArray<FTankShell> Shells;
+
+	/** Collision responses of ATankProjectile's sphere */
+	FCollisionResponseParams ResponseParams;
+
+	/** Whether the last UpdateVisuals left any instances, so they are only cleared once after the last shell */
+	bool bHasInstances;
+
+	int32 FindOrAddShellType(const TSubclassOf<ATankProjectile>& ProjectileClass);
+	void CreateVisuals(FTankShellType& ShellType);
+	void UpdateVisuals();
+	void SpawnHitParticleSystems(const FTankShellType& ShellType, const FVector& Location) const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+public:
+	UTankBallisticsSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/**
+	 * Fires a shell. Radius, gravity, lifetime, mesh and hit effects are taken from the projectile class.
+	 * @param ProjectileClass The projectile the shell behaves like
+	 * @param Origin Where the shell starts
+	 * @param Direction Direction of travel, does not need to be normalized
+	 * @param Speed Initial speed in cm/s
+	 * @param CallbackObject Implements IShootingInterface, gets ProjectileHit when the shell hits something
+	 * @param CatchUpTime How long ago the shell was fired. Covered by the first sweep, so it cannot skip through anything.
+	 * @param ShotId Passed back through IShootingInterface::ShotHit
+	 */
+	void FireShell(const TSubclassOf<ATankProjectile>& ProjectileClass, const FVector& Origin, const FVector& Direction,
+	               double Speed, UObject* CallbackObject = nullptr, float CatchUpTime = 0, uint16 ShotId = 0);
+
+	/**
+	 * Removes a shell that is still in flight and spawns its hit effect at Location.
+	 * @return false if no shell with that callback object and shot ID is in flight
+	 */
+	bool StopShell(const UObject* CallbackObject, uint16 ShotId, const FVector& Location);
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Ballistics")
+	int32 GetNumShellsInFlight() const { return Shells.Num(); }
+};
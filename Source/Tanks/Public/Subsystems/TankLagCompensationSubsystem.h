@@ -0,0 +1,92 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TankLagCompensationSubsystem.generated.h"
+
+class ATankCharacter;
+
+/**
+ * Where a tank was at one server frame. 64 bytes, one cache line.
+ */
+struct FTankHistoryFrame
+{
+	double Time;
+	FVector Location;
+	FQuat Rotation;
+};
+
+/**
+ * Fixed size ring buffer of one tank's transforms. Bounds are in local space and do not change, so they are stored once.
+ */
+struct FTankHistory
+{
+	/** About a second at 60 Hz */
+	static constexpr int32 NumFrames = 64;
+
+	TWeakObjectPtr<ATankCharacter> Tank;
+	FBox LocalBounds;
+
+	/** Index of the newest frame */
+	int32 Head;
+	int32 Num;
+
+	TStaticArray<FTankHistoryFrame, NumFrames> Frames;
+
+	FTankHistory(): LocalBounds(ForceInit), Head(INDEX_NONE), Num(0)
+	{
+	}
+
+	const FTankHistoryFrame& GetFrame(const int32 Age) const { return Frames[(Head - Age + NumFrames) % NumFrames]; }
+};
+
+/**
+ * Server side lag compensation. Records every tank's transform once per frame and can re-run a shot
+ * against where the tanks were when the shooter saw them, so the server no longer trusts the client's hit result.
+ */
+UCLASS(Config=Game)
+class TANKS_API UTankLagCompensationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+	/** Shots older than this are validated against the oldest allowed frame instead */
+	UPROPERTY(Config)
+	float MaxRewindTime;
+
+	/** Added to each side of a tank's bounds when checking a rewound shot */
+	UPROPERTY(Config)
+	float BoundsTolerance;
+
+	TArray<FTankHistory> Histories;
+
+	/** Interpolated transform of the tank at Time. false if there is no history yet */
+	bool GetTransformAtTime(const FTankHistory& History, double Time, FTransform& OutTransform) const;
+
+public:
+	UTankLagCompensationSubsystem();
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/** Only call on the server */
+	void RegisterTank(ATankCharacter* Tank);
+	void UnregisterTank(const ATankCharacter* Tank);
+
+	/**
+	 * Line trace with every tank moved back to where it was at Time. Everything else is traced as it is now.
+	 * @param Shooter Is ignored by the trace
+	 * @param Start Start of the shot
+	 * @param End End of the shot
+	 * @param Time Server time the shooter saw the world at, see ATankCharacter::GetShotViewTime
+	 * @param OutHit Closest hit, against a rewound tank or the world
+	 * @return true if the shot hit something
+	 */
+	bool RewindLineTrace(const ATankCharacter* Shooter, const FVector& Start, const FVector& End, double Time, FHitResult& OutHit) const;
+
+	/** Server time used for recording, same clock as AGameStateBase::GetServerWorldTimeSeconds */
+	double GetServerTime() const;
+
+	float GetMaxRewindTime() const { return MaxRewindTime; }
+};
@@ -0,0 +1,57 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TankOutlineSubsystem.generated.h"
+
+class ATankCharacter;
+
+/**
+ * Outline wanted on one registered tank and the stencil value its mesh last had set.
+ */
+struct FTankOutlineState
+{
+	TWeakObjectPtr<ATankCharacter> Tank;
+
+	bool bFriend = false;
+	bool bEnemy = false;
+
+	/** What the mesh had when the tank was registered, then the last value written. -1 if it had no mesh. */
+	int32 AppliedStencil = -1;
+};
+
+/**
+ * Client side. Owns the custom depth stencil of every tank mesh. OutlineTank only records whether a tank is
+ * outlined as a friend and/or an enemy; once a frame the wanted stencil of each tank is worked out
+ * (friend over enemy over none) and written to the mesh only if it differs from what was applied last.
+ */
+UCLASS()
+class TANKS_API UTankOutlineSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+	TArray<FTankOutlineState> Outlines;
+
+	/** Set when an outline request changed something, so frames with no changes skip the diff */
+	bool bDirty;
+
+	static int32 GetWantedStencil(const FTankOutlineState& State);
+
+public:
+	UTankOutlineSubsystem();
+
+	static constexpr int32 FriendStencilValue = 2;
+	static constexpr int32 EnemyStencilValue = 1;
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	void RegisterTank(ATankCharacter* Tank);
+	void UnregisterTank(const ATankCharacter* Tank);
+
+	/** Turns the friend or enemy outline of the tank on or off. Applied on the next tick. */
+	void SetOutline(ATankCharacter* Tank, bool bActivate, bool bIsFriend);
+};
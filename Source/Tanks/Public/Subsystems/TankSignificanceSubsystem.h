@@ -0,0 +1,116 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Libraries/TankEnumLibrary.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TankSignificanceSubsystem.generated.h"
+
+class ATankCharacter;
+
+/**
+ * Significance of one registered tank.
+ */
+struct FTankSignificance
+{
+	TWeakObjectPtr<ATankCharacter> Tank;
+
+	/** Fraction of the screen height the tank covers, the local tank is always on top */
+	float Score = 0;
+
+	ETankSignificance Bucket = ETankSignificance::High;
+
+	/** The skeletal mesh updates its animation every this many frames */
+	uint8 AnimTickRate = 1;
+
+	bool bWheelSmoke = true;
+
+	/** Emissive and hatch animation updates */
+	bool bCosmetics = true;
+};
+
+/**
+ * Client side. Scores every tank by distance, screen size and whether it is the local player's, puts it in an
+ * ETankSignificance bucket and throttles its animation from that. Lower buckets update their animation less often
+ * and skip the wheels and tracks when offscreen. The assumed animation cost of all tanks is kept under AnimBudgetMs.
+ * With split-screen, a tank is scored in whichever local player's view it is biggest in.
+ * Wheel smoke, emissive and hatch updates are only given to the most significant tanks.
+ * "tank.Debug.Significance 1" shows the bucket of every tank.
+ */
+UCLASS(Config=Game)
+class TANKS_API UTankSignificanceSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+	/** Significance is worked out this often, not every frame */
+	UPROPERTY(Config)
+	float UpdateInterval;
+
+	/** Tanks covering at least this fraction of the screen height are High */
+	UPROPERTY(Config)
+	float HighScreenSize;
+
+	/** Tanks covering at least this fraction of the screen height are Medium, smaller ones are Low */
+	UPROPERTY(Config)
+	float MediumScreenSize;
+
+	/** A tank that was not rendered for this long is Offscreen */
+	UPROPERTY(Config)
+	float OffscreenTime;
+
+	/** Animation update rate of each bucket, in frames. 1 is every frame. */
+	UPROPERTY(Config)
+	uint8 HighAnimTickRate;
+
+	UPROPERTY(Config)
+	uint8 MediumAnimTickRate;
+
+	UPROPERTY(Config)
+	uint8 LowAnimTickRate;
+
+	UPROPERTY(Config)
+	uint8 OffscreenAnimTickRate;
+
+	/**
+	 * Fixed cost assumed for one tank's animation update on the game and worker threads. It is not measured at runtime,
+	 * so profile a full match with "stat anim" on the target hardware and set it from that.
+	 */
+	UPROPERTY(Config)
+	float StaticAnimMsPerTank;
+
+	/** The least significant tanks get a slower update rate until StaticAnimMsPerTank over all tanks fits in this */
+	UPROPERTY(Config)
+	float AnimBudgetMs;
+
+	/** The budget never slows a tank's animation down further than this */
+	UPROPERTY(Config)
+	uint8 MaxAnimTickRate;
+
+	/** Only this many tanks have wheel smoke, the most significant ones */
+	UPROPERTY(Config)
+	int32 MaxWheelSmokeTanks;
+
+	/** Tanks in this bucket or a more significant one get emissive and hatch animation updates */
+	UPROPERTY(Config)
+	ETankSignificance CosmeticBucketLimit;
+
+	TArray<FTankSignificance> Tanks;
+	float TimeSinceUpdate;
+
+	uint8 GetBucketAnimTickRate(ETankSignificance Bucket) const;
+	void ApplySignificance(const FTankSignificance& Significance) const;
+
+public:
+	UTankSignificanceSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	void RegisterTank(ATankCharacter* Tank);
+	void UnregisterTank(const ATankCharacter* Tank);
+
+	/** Bucket of the tank from the last update. High if it is not registered. */
+	ETankSignificance GetSignificance(const ATankCharacter* Tank) const;
+};
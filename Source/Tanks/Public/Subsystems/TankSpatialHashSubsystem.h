@@ -0,0 +1,100 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Libraries/TankEnumLibrary.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TankSpatialHashSubsystem.generated.h"
+
+class ATankCharacter;
+
+/**
+ * A run of UTankSpatialHashSubsystem::CellIndices that is in the same cell.
+ */
+struct FTankHashCell
+{
+	int32 Start;
+	int32 Num;
+};
+
+/**
+ * Every live tank in a uniform grid on the XY plane, rebuilt once per frame. Positions, radii and teams are kept
+ * in separate arrays, index i is the same tank in each, so queries only touch the data they need.
+ * Answers radius, cone and box queries against each tank's bounding sphere without going through the physics scene.
+ * The grid is rebuilt when tickable objects tick, after actors, so queries from actor ticks see last frame's positions.
+ */
+UCLASS(Config=Game)
+class TANKS_API UTankSpatialHashSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+	/** Edge length of a grid cell. Works best around the radius of the most common query. */
+	UPROPERTY(Config)
+	float CellSize;
+
+	TArray<TWeakObjectPtr<ATankCharacter>> RegisteredTanks;
+
+	/** Null for tanks unregistered since the last rebuild */
+	TArray<ATankCharacter*> Tanks;
+
+	/** Padded to a multiple of four, see QueryTeamInRange */
+	TArray<float> PositionsX;
+	TArray<float> PositionsY;
+	TArray<float> PositionsZ;
+	TArray<float> Radii;
+	TArray<ETeam> Teams;
+
+	/** Tank indices sorted by cell */
+	TArray<int32> CellIndices;
+	TMap<FIntPoint, FTankHashCell> Cells;
+
+	/** Scratch, the cell of each tank while rebuilding */
+	TArray<FIntPoint> TankCells;
+
+	/** Largest radius of any tank, cells are searched this much further out */
+	float MaxRadius;
+
+	FIntPoint GetCell(float X, float Y) const;
+	FVector GetPosition(const int32 Index) const { return FVector(PositionsX[Index], PositionsY[Index], PositionsZ[Index]); }
+
+	void Rebuild();
+
+	/** Calls Function with the index of every tank in a cell touched by the XY extent of Min to Max */
+	template <typename FunctionType>
+	void ForEachCandidate(const FVector& Min, const FVector& Max, const AActor* IgnoreActor, FunctionType&& Function) const;
+
+public:
+	UTankSpatialHashSubsystem();
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	void RegisterTank(ATankCharacter* Tank);
+	void UnregisterTank(const ATankCharacter* Tank);
+
+	/**
+	 * Tanks whose bounds overlap a sphere. Tanks are appended to OutTanks, each at most once per query.
+	 * @param IgnoreActor Left out of the results, usually the tank asking
+	 */
+	void QueryRadius(const FVector& Center, float Radius, TArray<ATankCharacter*>& OutTanks, const AActor* IgnoreActor = nullptr) const;
+
+	/**
+	 * Tanks whose bounds overlap a cone.
+	 * @param Origin Tip of the cone
+	 * @param Direction Axis of the cone, normalized
+	 */
+	void QueryCone(const FVector& Origin, const FVector& Direction, float Length, float StartRadius, float EndRadius,
+	               TArray<ATankCharacter*>& OutTanks, const AActor* IgnoreActor = nullptr) const;
+
+	/** Tanks whose bounds overlap a rotated box */
+	void QueryBox(const FVector& Center, const FVector& HalfExtent, const FQuat& Rotation, TArray<ATankCharacter*>& OutTanks,
+	              const AActor* IgnoreActor = nullptr) const;
+
+	/**
+	 * Tanks of a team whose centers are at most Radius away from Center.
+	 * A batch pass over every tank, comparing four squared distances at a time.
+	 */
+	void QueryTeamInRange(ETeam Team, const FVector& Center, float Radius, TArray<ATankCharacter*>& OutInRange,
+	                      const AActor* IgnoreActor = nullptr) const;
+};
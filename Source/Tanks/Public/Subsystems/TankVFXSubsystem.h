@@ -0,0 +1,98 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TankVFXSubsystem.generated.h"
+
+class UNiagaraComponent;
+class UNiagaraSystem;
+struct FProjectileSettings;
+
+/**
+ * How many components are created up front for a Niagara system. Set in DefaultGame.ini.
+ */
+USTRUCT()
+struct FTankVFXPoolSize
+{
+	GENERATED_BODY()
+
+	UPROPERTY(Config)
+	TSoftObjectPtr<UNiagaraSystem> System;
+
+	UPROPERTY(Config)
+	int32 PoolSize;
+
+	FTankVFXPoolSize(): PoolSize(8)
+	{
+	}
+};
+
+/**
+ * Free components of one Niagara system.
+ */
+USTRUCT()
+struct FTankNiagaraPool
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<TObjectPtr<UNiagaraComponent>> FreeComponents;
+
+	/** Components created after pre-warming because the pool ran dry */
+	int32 Misses;
+
+	/** The pre-warm size. Components returned beyond it are destroyed, so a burst does not keep its peak count. */
+	int32 PoolSize;
+
+	FTankNiagaraPool(): Misses(0), PoolSize(0)
+	{
+	}
+};
+
+/**
+ * Spawns projectile and impact effects. Honours FProjectileSettings::bUseNiagaraSystem and keeps pre-warmed
+ * Niagara components per system, so a lot of impacts in one frame does not create components mid-frame.
+ * Components go back to their pool when the system finishes, up to the pool's pre-warm size.
+ * Not created on dedicated servers, so GetSubsystem returns null there and callers skip effects entirely.
+ */
+UCLASS(Config=Game)
+class TANKS_API UTankVFXSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+	/** Systems to pre-warm on begin play, and how many components each */
+	UPROPERTY(Config)
+	TArray<FTankVFXPoolSize> PooledSystems;
+
+	/** Pre-warm size for systems that are not in PooledSystems. Their pool is created on first use. */
+	UPROPERTY(Config)
+	int32 DefaultPoolSize;
+
+	UPROPERTY()
+	TMap<TObjectPtr<UNiagaraSystem>, FTankNiagaraPool> Pools;
+
+	FTankNiagaraPool& FindOrCreatePool(UNiagaraSystem* System, int32 PoolSize);
+	UNiagaraComponent* CreatePooledComponent(UNiagaraSystem* System);
+	UNiagaraComponent* AcquireComponent(UNiagaraSystem* System);
+
+	UFUNCTION()
+	void OnPooledSystemFinished(UNiagaraComponent* Component);
+
+public:
+	UTankVFXSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+	/** Spawns the Niagara or the Cascade system of the settings, never both */
+	void SpawnAtLocation(const FProjectileSettings& Settings, const FVector& Location, const FRotator& Rotation = FRotator::ZeroRotator);
+
+	/** Spawns the Niagara or the Cascade system of the settings attached to a component */
+	void SpawnAttached(const FProjectileSettings& Settings, USceneComponent* AttachToComponent, const FVector& Location);
+
+	UNiagaraComponent* SpawnNiagaraAtLocation(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation = FRotator::ZeroRotator);
+	UNiagaraComponent* SpawnNiagaraAttached(UNiagaraSystem* System, USceneComponent* AttachToComponent, const FVector& Location);
+};
@@ -6,7 +6,11 @@
 #include "TankInterface.h"
 // #include "WheeledVehiclePawn.h"
 #include "GameFramework/TankGameInstance.h"
+#include "GameFramework/TankTickSettings.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "Libraries/TankEnumLibrary.h"
+#include "Libraries/TankStructLibrary.h"
+#include "Libraries/TFL.h"
 #include "Projectiles/ShootingInterface.h"
 #include "Tanks/Template/MyProjectSportsCar.h"
 #include "TankCharacter.generated.h"
@@ -55,6 +59,7 @@ struct FConeTraceConfig
 	GENERATED_BODY()
 
 	// Only one config should have this on !!!
+	// Configs with this off are only drawn for debugging.
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, DisplayName="Is Used For Tank Targeting?", Category = "Setup|Cone Trace", meta=(SliderExponent=1.3))
 	bool bIsUsedForTankTargeting;
 
@@ -136,6 +141,7 @@ class TANKS_API ATankCharacter : public AMyProjectSportsCar, public ITankInterfa
 	virtual void OnConstruction(const FTransform& Transform) override;
 	virtual auto GetLifetimeReplicatedProps(TArray<class FLifetimeProperty>& OutLifetimeProps) const -> void override;
 	virtual void PossessedBy(AController* NewController) override;
+	virtual void NotifyControllerChanged() override;
 
 	void BindDelegates();
 	
@@ -145,6 +151,25 @@ class TANKS_API ATankCharacter : public AMyProjectSportsCar, public ITankInterfa
 	void SetWheelIndices();
 	virtual void Tick(float DeltaTime) override;
 
+	/** Scheduling state of every ETankTickTask, indexed by the task */
+	TStaticArray<FTankTickTaskState, static_cast<uint32>(ETankTickTask::Num)> TickTasks;
+
+	/** Picks the tier of every tick task from UTankTickSettings for this tank's role. Called again when the controller changes. */
+	void ResolveTickTiers();
+
+	/**
+	 * Adds DeltaTime to the task and decides if it runs this tick.
+	 * @param OutDeltaTime Time since the task last ran, pass this to the task instead of the frame's DeltaTime
+	 */
+	bool ShouldRunTickTask(ETankTickTask Task, float DeltaTime, float& OutDeltaTime);
+
+	/**
+	 * ShouldRunTickTask for the tasks that read back async traces, which are only kept for the frame after the request.
+	 * Below every frame the traces are requested on the tick before the task is due and the task runs on the next tick.
+	 * If that tick skips the task, the traces are requested again the next time it is checked.
+	 * @param bOutRequestTraces Request the task's traces after it, they are read by its next run
+	 */
+	bool ShouldRunAsyncTickTask(ETankTickTask Task, float DeltaTime, float& OutDeltaTime, bool& bOutRequestTraces);
 
 	bool IsEnemy(AActor* OtherActor) const;
 	virtual float TakeDamage(float DamageAmount, struct FDamageEvent const& DamageEvent, class AController* EventInstigator, AActor* DamageCauser) override;
@@ -163,7 +188,7 @@ protected:
 	UFUNCTION(BlueprintNativeEvent)
 	void SetDefaults();
 
-	/** Traces spheres increasing in radius in the shape of a cone. */
+	/** Finds the vehicles in each cone with UTFL::ConeOverlapVehicles and feeds them to the targeting system. */
 	UFUNCTION(BlueprintNativeEvent)
 	void ConeTraceTick();
 	bool bConeTraceDisabled;
@@ -173,8 +198,41 @@ protected:
 	// removing every frame.
 	UPROPERTY()
 	TArray<AActor*> AllHits;
-	UPROPERTY()
-	TArray<FHitResult> Hits;
+
+	/** Async cone query of the targeting config, read back on the next tick */
+	FConeQueryHandle ConeQueryHandle;
+
+	/** Length of the targeting cone after it was shortened by a blocker, from the last finished query */
+	float ConeTraceLength;
+
+	/**
+	 * The camera, turret and barrel traces are async. They are requested during Tick and read back on the next Tick,
+	 * so their hits are always one frame old. This is fine for the smoothed camera point and the barrel clearance checks.
+	 * The turret trace decides where a shot goes, so OnShoot re-traces it synchronously with TraceTurretNow.
+	 * Tick requests them through ShouldRunAsyncTickTask, the tasks only read them back.
+	 */
+	FTraceHandle CameraTraceHandle;
+	FTraceHandle TurretTraceHandle;
+	FTraceHandle BarrelTopTraceHandle;
+	FTraceHandle BarrelBottomTraceHandle;
+
+	FHitResult BarrelTopHit;
+	FHitResult BarrelBottomHit;
+
+	/** Visibility line trace that runs on the physics thread, read it back with ConsumeAsyncLineTrace on the next frame */
+	FTraceHandle RequestAsyncLineTrace(const FVector& Start, const FVector& End, bool bIgnoreSelf) const;
+
+	/** Copies the result of a finished async trace into OutHit. Returns false and leaves OutHit alone if it is not ready. */
+	bool ConsumeAsyncLineTrace(FTraceHandle& Handle, FHitResult& OutHit) const;
+
+	/** Requests the async traces read by the next CameraTraceTick, TurretTraceTick, CheckIfGunCanLowerElevationTick and ConeTraceTick */
+	void RequestCameraTrace();
+	void RequestTurretTrace();
+	void RequestBarrelTraces();
+	void RequestConeQuery();
+
+	/** Synchronous turret trace from the current muzzle, used when shooting so the shot is never a frame behind */
+	void TraceTurretNow();
 
 	/** Traces from the muzzle to the point where it is looking at ahead. */
 	UFUNCTION(BlueprintNativeEvent)
@@ -191,12 +249,30 @@ protected:
 
 	void UpdateDesiredTurretAngle();
 
-	UFUNCTION(BlueprintCallable, Client, Unreliable)
-	void CL_UpdateGunSightPosition();
+	/** Projects the turret trace, or AuthoritativeAimPoint if it is on the same line of fire, onto the gun sight widget.
+	 * Only does anything on the owning client. */
+	UFUNCTION(BlueprintCallable)
+	void UpdateGunSightPosition();
+
+	/**
+	 * Where the server thinks this tank's turret is aiming. Quantised to whole units and only sent to the owner.
+	 * The server only writes it when its aim point moved further than AimPointReplicationThreshold from the last value,
+	 * so it is not resent while the turret is steady. The owner's gun sight shows it instead of its own trace
+	 * whenever it is on the owner's line of fire.
+	 */
+	UPROPERTY(BlueprintReadOnly, Replicated)
+	FVector_NetQuantize AuthoritativeAimPoint;
+
+	/** Server only. Updates AuthoritativeAimPoint from the turret trace if it moved far enough. */
+	void UpdateAuthoritativeAimPoint();
 public:
 	UFUNCTION(BlueprintCallable)
 	void SetDesiredTurretAngle(float TurretAngle);
 
+	/** Runs the task on the next tick whatever its tier is. This is the only way OnEvent tasks run. */
+	UFUNCTION(BlueprintCallable)
+	void RequestTickTask(ETankTickTask Task);
+
 private:
 	double DesiredTurretAngle_C;
 protected:
@@ -223,6 +299,7 @@ protected:
 	
 	// IShootingInterface functions start
 	virtual void ProjectileHit_Implementation(ATankProjectile* TankProjectile, UPrimitiveComponent* HitComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit) override;
+	virtual void ShotHit(uint16 ShotId, const FHitResult& Hit) override;
 	// IShootingInterface functions end
 
 	UFUNCTION(BlueprintNativeEvent)
@@ -236,11 +313,44 @@ protected:
 	UFUNCTION(BlueprintNativeEvent)
 	void ApplyTankShootImpulse() const;
 	
-	UFUNCTION(BlueprintCallable, Server, Reliable)
+	/** Kept for Blueprints that still call it. No longer an RPC, only does anything on the server, where it calls MC_ApplyRadialDamage. */
+	UFUNCTION(BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="The server confirms hits itself, clients can not apply damage any more."))
 	void SR_ApplyRadialDamage(const FHitResult& Hit);
 
+	/** Only called by the server, once SR_ConfirmHitscanShot confirmed a hit */
 	UFUNCTION(NetMulticast, Reliable)
 	void MC_ApplyRadialDamage(const FHitResult& Hit);
+
+	/**
+	 * Asks the server to re-run a hitscan shot with lag compensation instead of trusting the client's hit result.
+	 * @param Start Where the client's turret trace started
+	 * @param End Where the client's turret trace ended, only its direction is used
+	 * @param ViewTime Server time of the world the client saw when shooting
+	 */
+	UFUNCTION(Server, Reliable)
+	void SR_ConfirmHitscanShot(const FVector_NetQuantize& Start, const FVector_NetQuantize& End, double ViewTime);
+
+	/** Estimated server time of what this client sees, i.e. the server time minus half the ping */
+	double GetShotViewTime() const;
+
+	/** Spawns the shell from this machine's projectile pool. The tank that fired it reports the hit. */
+	void FireProjectile(const FProjectileSpawnParams& Params);
+
+	/** A shot is sent once as its spawn parameters, the projectile itself never replicates */
+	UFUNCTION(Server, Reliable)
+	void SR_FireProjectile(const FProjectileSpawnParams& Params);
+
+	/** Skipped by the tank that fired, it spawned its shell straight away */
+	UFUNCTION(NetMulticast, Reliable)
+	void MC_FireProjectile(const FProjectileSpawnParams& Params);
+
+	/**
+	 * The server's copy of a shell hit something. Ends every other copy of it at the same place and applies the damage.
+	 * @param ShotId FProjectileSpawnParams::ShotId of the shell
+	 * @param Location Where the server's copy hit
+	 */
+	UFUNCTION(NetMulticast, Reliable)
+	void MC_ConfirmShotHit(uint16 ShotId, const FVector_NetQuantize& Location);
 	
 	/** Updates how much up or down you can look based on the tank rotation */
 	UFUNCTION(BlueprintNativeEvent)
@@ -365,6 +475,34 @@ protected:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Gameplay|Damage", meta=(UIMin=2, UIMax=20, MakeStructureDefaultValue=10))
 	double DamageFalloffExponent;
 
+	/** Decides which shots are hitscan and which are simulated projectiles */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Gameplay|Ballistics")
+	ETankBallisticsMode BallisticsMode;
+
+	/** In Auto mode, shots that would take less than this to reach the target are hitscan. Their impact effects are still delayed by the travel time. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Gameplay|Ballistics", meta=(UIMin=0, UIMax=1, ClampMin=0, Units="Seconds"))
+	double HitscanTimeThreshold;
+
+	/** The server rejects hitscan shots that start further than this from its own muzzle location */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Gameplay|Ballistics", meta=(UIMin=0, UIMax=2000, ClampMin=0))
+	double MaxMuzzleError;
+
+	/** Used to predict the time to impact. Should match the speed of the pooled projectile. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Gameplay|Ballistics", meta=(UIMin=1000, UIMax=100000, ClampMin=1))
+	double ShellSpeed;
+
+	/** The owning client resends an unchanged aim state this often, in case the last change was dropped */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Gameplay|Turret", meta=(UIMin=0.1, UIMax=2, ClampMin=0.01, Units="Seconds"))
+	float AimStateResendInterval;
+
+	/** How fast other players' turrets and guns follow their replicated aim state */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Gameplay|Turret", meta=(UIMin=1, UIMax=50, ClampMin=0))
+	float AimStateInterpSpeed;
+
+	/** How far the server's aim point has to move before AuthoritativeAimPoint is replicated again */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Gameplay|Turret", meta=(UIMin=0, UIMax=500, ClampMin=0))
+	double AimPointReplicationThreshold;
+
 	// Toggles all debug traces for turret. Is controlled in BP or in game.
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Setup|Debug")
 	bool bShowDebugTracesForTurret;
@@ -388,9 +526,48 @@ protected:
 	double GunElevation;
 
 	/** Turret Left/Right Rotation */
-	UPROPERTY(BlueprintReadOnly, Category = "Default", Replicated)
+	UPROPERTY(BlueprintReadOnly, Category = "Default")
 	double CurrentTurretAngle;
 
+	/**
+	 * Turret and gun angles of this tank for everyone but its owner. The owner sends its angles with SR_SetAimState
+	 * and everyone else interpolates their anim instance towards this in InterpolateAimState.
+	 */
+	UPROPERTY(Replicated)
+	FTankAimState AimState;
+
+	/** The last aim state the owning client sent to the server */
+	FTankAimState SentAimState;
+	double LastAimStateSendTime;
+
+	/** Set by UTankSignificanceSubsystem, see SetCosmeticsEnabled */
+	bool bWheelSmokeEnabled;
+	bool bCosmeticsEnabled;
+
+	/** Last value given to SetLightsEmissivity, applied when cosmetics are turned back on */
+	double CurrentLightsEmissivity;
+
+	/** Owning client only. The next FProjectileSpawnParams::ShotId. */
+	uint16 NextShotId;
+
+	/** Server only. World time of the last shot the server accepted from this tank. */
+	double LastServerShotTime;
+
+	/** Server only. false if the shoot cooldown of the controller has not passed since the last accepted shot, otherwise starts it again. */
+	bool TryConsumeServerShot();
+
+	/** Server only. A shell starts at the server's muzzle, or at the end of the turret trace if the client's trace hit nothing. */
+	bool IsProjectileOriginValid(const FProjectileSpawnParams& Params) const;
+
+	/** Owning client only. Sends the anim instance's turret and gun angles to the server if they changed. */
+	void SendAimState();
+
+	UFUNCTION(Server, Unreliable)
+	void SR_SetAimState(const FTankAimState& NewAimState);
+
+	/** Moves the anim instance's turret and gun angles towards AimState on tanks that are not locally controlled */
+	void InterpolateAimState(float DeltaTime);
+
 	/** Please add a variable description */
 	UPROPERTY(BlueprintReadOnly, Category = "Default")
 	TObjectPtr<UTankAnimInstance> AnimInstance;
@@ -521,63 +698,50 @@ public:
 	TObjectPtr<UMaterialInstanceDynamic> TracksMaterial;
 
 public:
-	void SpawnProjectileFromPool();
-	/** Please add a function description */
+	/** Spawns a pooled projectile at Start flying towards End */
+	void SpawnProjectileFromPool(const FVector& Start, const FVector& End);
+
+	/** Applies the shot's damage now and spawns the impact effect once a shell would have arrived */
+	void ResolveHitscanShot(const FHitResult& Hit, double TimeToImpact);
+	/** Sets the gun elevation of the locally controlled tank. Other machines get it through AimState. */
 	UFUNCTION(BlueprintCallable)
-	void SetGunElevation(double NewGunElevation) const;
+	void SetGunElevation(double NewGunElevation);
 
 	/** Simple function that spawns a new particle everytime. */
 	UFUNCTION(BlueprintCallable)
 	void SpawnHitParticleSystem(const FHitResult& Location) const;
 
-protected:
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_SetGunElevation(double NewGunElevation) const;
-	
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_SetGunElevation(double NewGunElevation) const;
-public:
-	/** Please add a function description */
+	/** Sets the turret angle of the locally controlled tank. Other machines get it through AimState. */
 	UFUNCTION(BlueprintCallable)
-	void SetTurretRotation(double NewTurretAngle) const;
-protected:
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_SetTurretRotation(double NewTurretAngle) const;
+	void SetTurretRotation(double NewTurretAngle);
 
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_SetTurretRotation(double NewTurretAngle) const;
-public:
 	/** Please add a function description */
 	UFUNCTION(BlueprintCallable)
 	void SetSkinType(double NewSkinType) const;
 
-	/** Please add a function description */
+	/** Cosmetic only, so it is set on this machine and never replicated. Skipped while cosmetics are off for this tank. */
 	UFUNCTION(BlueprintCallable)
-	void SetLightsEmissivity(double LightsEmissivity) const;
+	void SetLightsEmissivity(double LightsEmissivity);
+
+	/**
+	 * Called by UTankSignificanceSubsystem. Turns this tank's cosmetics on or off for this machine only.
+	 * @param bInWheelSmokeEnabled Whether the tank can have wheel smoke
+	 * @param bInCosmeticsEnabled Whether the tank gets emissive and hatch animation updates
+	 */
+	void SetCosmeticsEnabled(bool bInWheelSmokeEnabled, bool bInCosmeticsEnabled);
 protected:
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_SetLightsEmissivity(double LightsEmissivity) const;
-	
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_SetLightsEmissivity(double LightsEmissivity) const;
+	/** Kept for Blueprints that still call it. No longer an RPC, forwards to SetLightsEmissivity on this machine. */
+	UFUNCTION(BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="Lights are cosmetic and no longer replicated, call SetLightsEmissivity."))
+	void SR_SetLightsEmissivity(double LightsEmissivity);
+
+	/** Kept for Blueprints that still call it. No longer an RPC, forwards to SetLightsEmissivity on this machine. */
+	UFUNCTION(BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="Lights are cosmetic and no longer replicated, call SetLightsEmissivity."))
+	void MC_SetLightsEmissivity(double LightsEmissivity);
 public:
-	/** Please add a function description */
+
+	/** Sets the wheel speed and wheel smoke on this machine only. Tick calls it with the vehicle's forward speed. */
 	UFUNCTION(BlueprintCallable)
 	void SetSpeed(double Speed);
-
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, Server, Reliable)
-	void SR_SetSpeed(double Speed);
-
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, NetMulticast, Reliable)
-	void MC_SetSpeed(double Speed);
 public:
 	/** Please add a function description */
 	UFUNCTION(BlueprintCallable)
@@ -634,12 +798,12 @@ public:
 	UFUNCTION(BlueprintImplementableEvent)
 	void ToggleMiddleCamera();
 protected:
-	/** Please add a function description */
+	/** Cosmetic only, called on every machine. Not called while UTankSignificanceSubsystem has wheel smoke off for this tank. */
 	UFUNCTION(BlueprintCallable, BlueprintImplementableEvent, DisplayName="SetWheelSmokeIntensity")
 	void SetWheelSmoke(float Intensity);
 
-	/** Please add a function description */
-	UFUNCTION(BlueprintCallable, DisplayName="MC_SetWheelSmokeIntensity", NetMulticast, Reliable)
+	/** Kept for Blueprints that still call it. No longer an RPC, sets the smoke on this machine if it is enabled for this tank. */
+	UFUNCTION(BlueprintCallable, DisplayName="MC_SetWheelSmokeIntensity", meta=(DeprecatedFunction, DeprecationMessage="Wheel smoke is cosmetic and no longer replicated, call SetWheelSmokeIntensity."))
 	void MC_SetWheelSmoke(float Intensity);
 
 public:
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/PlayerController.h"
+#include "Libraries/TankStructLibrary.h"
 #include "TankController.generated.h"
 
 class UChaosWheeledVehicleMovementComponent;
@@ -37,6 +38,7 @@ class TANKS_API ATankController : public APlayerController
 	void HandleVehicleDeceleration();
 	void RefreshTankPlayerState();
 	virtual void Tick(float DeltaSeconds) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 	FORCEINLINE void UpdateTickEnable(const bool bEnable);
 	UFUNCTION(BlueprintCallable)
 	void SetDefaults();
@@ -159,6 +161,14 @@ protected:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Controls")
 	FVector2D MouseSensitivity;
 
+	/** How many input frames per second the owning client sends to the server */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Controls|Network", meta=(ClampMin=1, UIMin=10, UIMax=60))
+	float InputSendRate;
+
+	/** Unacknowledged frames are resent with every batch, up to this many, so a dropped packet does not lose input */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Setup|Controls|Network", meta=(ClampMin=1, UIMin=1, UIMax=32))
+	int32 MaxInputFramesPerBatch;
+
 	UPROPERTY(BlueprintReadOnly)
 	bool bIsAlive;
 
@@ -196,33 +206,48 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Default", meta=(AllowPrivateAccess="true"))
 	bool bShootingBlocked;
 
+	///////////////////////////////////////////////////////////////////////////////////
+	/// Input frames
+
+	/**
+	 * The owning client applies its own move and turn input straight away and records it in input frames
+	 * at InputSendRate. The frames the server has not acknowledged yet are sent in one unreliable batch.
+	 * The server applies the new ones in order and acknowledges the last one through AckedInputFrame.
+	 * Physics replication corrects the owner's tank if it drifted from the server's, and is all simulated proxies get.
+	 */
+	TArray<FTankInputFrame> UnackedInputFrames;
+
+	/** The last frame that was recorded, idle input is not recorded twice */
+	FTankInputFrame LastInputFrame;
+	uint16 NextInputFrame;
+	double InputSendTime;
+
+	/** Records the next frame even if the input did not change, set on respawn */
+	bool bForceInputFrame;
+
+	/** The last input frame the server applied. Frames it had to reject are not acknowledged. */
+	UPROPERTY(Replicated)
+	uint16 AckedInputFrame;
+
+	/** Owning client only. Records this frame's input and sends every unacknowledged frame. */
+	void SendInputFrames(float DeltaSeconds);
+
+	UFUNCTION(Server, Unreliable)
+	void SR_SendInputFrames(const TArray<FTankInputFrame>& Frames);
+
+	/** false if the input could not be registered, the frame is then not acknowledged */
+	bool ApplyInputFrame(const FTankInputFrame& Frame);
+
 	///////////////////////////////////////////////////////////////////////////////////
 	/// Input functions
 	
 	/** Called for movement input */
 	virtual void Move(const FInputActionValue& Value);
-
-	UFUNCTION(Server, Reliable)
-	virtual void SR_Move(double Value);
-	UFUNCTION(NetMulticast, Reliable)
-	virtual void MC_Move(double Value);
 	virtual void Move__Internal(double Value);
 
 	/** Called for looking input */
 	void Look(const FInputActionValue& Value);
 	void Turn__Internal(double Value);
-
-	UFUNCTION(Server, Reliable)
-	void SR_Turn(const FInputActionValue& Value);
-
-	UFUNCTION(NetMulticast, Reliable)
-	void MC_Turn(const FInputActionValue& Value);
-
-	UFUNCTION(Server, Reliable)
-	void SR_TurnCompleted(const FInputActionValue& Value);
-
-	UFUNCTION(NetMulticast, Reliable)
-	void MC_TurnCompleted(const FInputActionValue& Value);
 	
 	/** Called for turning input */
 	void Turn(const FInputActionValue& Value);
@@ -260,6 +285,8 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Data")
 	bool CanShoot() const { return bCanShoot; }
 
+	double GetShootTimerDuration() const { return ShootTimerDuration; }
+
 	UFUNCTION(BlueprintCallable, Category="Data")
 	void SetCanShoot(bool bCanShootLoc) { this->bCanShoot = bCanShootLoc; }
 